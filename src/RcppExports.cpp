@@ -52,8 +52,8 @@ BEGIN_RCPP
 END_RCPP
 }
 // popsnetwork
-XPtr<Net_t> popsnetwork(const DataFrame& links, const DataFrame& external, double transmission, double decay, const string& spread_model, bool checks);
-RcppExport SEXP _rpathsonpaths_popsnetwork(SEXP linksSEXP, SEXP externalSEXP, SEXP transmissionSEXP, SEXP decaySEXP, SEXP spread_modelSEXP, SEXP checksSEXP) {
+XPtr<Net_t> popsnetwork(const DataFrame& links, const DataFrame& external, double transmission, double decay, const string& spread_model, bool checks, int threads, Nullable<NumericVector> seed);
+RcppExport SEXP _rpathsonpaths_popsnetwork(SEXP linksSEXP, SEXP externalSEXP, SEXP transmissionSEXP, SEXP decaySEXP, SEXP spread_modelSEXP, SEXP checksSEXP, SEXP threadsSEXP, SEXP seedSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -63,7 +63,61 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< double >::type decay(decaySEXP);
     Rcpp::traits::input_parameter< const string& >::type spread_model(spread_modelSEXP);
     Rcpp::traits::input_parameter< bool >::type checks(checksSEXP);
-    rcpp_result_gen = Rcpp::wrap(popsnetwork(links, external, transmission, decay, spread_model, checks));
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< Nullable<NumericVector> >::type seed(seedSEXP);
+    rcpp_result_gen = Rcpp::wrap(popsnetwork(links, external, transmission, decay, spread_model, checks, threads, seed));
+    return rcpp_result_gen;
+END_RCPP
+}
+// change_rates
+XPtr<Net_t> change_rates(const XPtr<Net_t>& p_net, Nullable<DataFrame> links, Nullable<DataFrame> external);
+RcppExport SEXP _rpathsonpaths_change_rates(SEXP p_netSEXP, SEXP linksSEXP, SEXP externalSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const XPtr<Net_t>& >::type p_net(p_netSEXP);
+    Rcpp::traits::input_parameter< Nullable<DataFrame> >::type links(linksSEXP);
+    Rcpp::traits::input_parameter< Nullable<DataFrame> >::type external(externalSEXP);
+    rcpp_result_gen = Rcpp::wrap(change_rates(p_net, links, external));
+    return rcpp_result_gen;
+END_RCPP
+}
+// fluid_sweep
+NumericMatrix fluid_sweep(const DataFrame& links, const DataFrame& external, const NumericVector& transmission, const NumericVector& decay, bool checks, const string& precision);
+RcppExport SEXP _rpathsonpaths_fluid_sweep(SEXP linksSEXP, SEXP externalSEXP, SEXP transmissionSEXP, SEXP decaySEXP, SEXP checksSEXP, SEXP precisionSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const DataFrame& >::type links(linksSEXP);
+    Rcpp::traits::input_parameter< const DataFrame& >::type external(externalSEXP);
+    Rcpp::traits::input_parameter< const NumericVector& >::type transmission(transmissionSEXP);
+    Rcpp::traits::input_parameter< const NumericVector& >::type decay(decaySEXP);
+    Rcpp::traits::input_parameter< bool >::type checks(checksSEXP);
+    Rcpp::traits::input_parameter< const string& >::type precision(precisionSEXP);
+    rcpp_result_gen = Rcpp::wrap(fluid_sweep(links, external, transmission, decay, checks, precision));
+    return rcpp_result_gen;
+END_RCPP
+}
+// source_attribution
+SEXP source_attribution(const XPtr<Net_t>& p_net, bool sparse);
+RcppExport SEXP _rpathsonpaths_source_attribution(SEXP p_netSEXP, SEXP sparseSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const XPtr<Net_t>& >::type p_net(p_netSEXP);
+    Rcpp::traits::input_parameter< bool >::type sparse(sparseSEXP);
+    rcpp_result_gen = Rcpp::wrap(source_attribution(p_net, sparse));
+    return rcpp_result_gen;
+END_RCPP
+}
+// infection_gradient
+List infection_gradient(const XPtr<Net_t>& p_net);
+RcppExport SEXP _rpathsonpaths_infection_gradient(SEXP p_netSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const XPtr<Net_t>& >::type p_net(p_netSEXP);
+    rcpp_result_gen = Rcpp::wrap(infection_gradient(p_net));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -90,27 +144,47 @@ BEGIN_RCPP
 END_RCPP
 }
 // popgen_dirichlet
-XPtr<Net_t> popgen_dirichlet(const XPtr<Net_t>& p_net, double theta, Nullable<List> ini_dist);
-RcppExport SEXP _rpathsonpaths_popgen_dirichlet(SEXP p_netSEXP, SEXP thetaSEXP, SEXP ini_distSEXP) {
+XPtr<Net_t> popgen_dirichlet(const XPtr<Net_t>& p_net, double theta, Nullable<List> ini_dist, Nullable<NumericVector> seed, int threads);
+RcppExport SEXP _rpathsonpaths_popgen_dirichlet(SEXP p_netSEXP, SEXP thetaSEXP, SEXP ini_distSEXP, SEXP seedSEXP, SEXP threadsSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< const XPtr<Net_t>& >::type p_net(p_netSEXP);
     Rcpp::traits::input_parameter< double >::type theta(thetaSEXP);
     Rcpp::traits::input_parameter< Nullable<List> >::type ini_dist(ini_distSEXP);
-    rcpp_result_gen = Rcpp::wrap(popgen_dirichlet(p_net, theta, ini_dist));
+    Rcpp::traits::input_parameter< Nullable<NumericVector> >::type seed(seedSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(popgen_dirichlet(p_net, theta, ini_dist, seed, threads));
     return rcpp_result_gen;
 END_RCPP
 }
 // popgen_ibm_mixed
-XPtr<Net_t> popgen_ibm_mixed(const XPtr<Net_t>& p_net, Nullable<List> ini_dist);
-RcppExport SEXP _rpathsonpaths_popgen_ibm_mixed(SEXP p_netSEXP, SEXP ini_distSEXP) {
+XPtr<Net_t> popgen_ibm_mixed(const XPtr<Net_t>& p_net, Nullable<List> ini_dist, Nullable<NumericVector> seed, int threads);
+RcppExport SEXP _rpathsonpaths_popgen_ibm_mixed(SEXP p_netSEXP, SEXP ini_distSEXP, SEXP seedSEXP, SEXP threadsSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< const XPtr<Net_t>& >::type p_net(p_netSEXP);
     Rcpp::traits::input_parameter< Nullable<List> >::type ini_dist(ini_distSEXP);
-    rcpp_result_gen = Rcpp::wrap(popgen_ibm_mixed(p_net, ini_dist));
+    Rcpp::traits::input_parameter< Nullable<NumericVector> >::type seed(seedSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(popgen_ibm_mixed(p_net, ini_dist, seed, threads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// popgen_ibm_replicates
+List popgen_ibm_replicates(const XPtr<Net_t>& p_net, int n, Nullable<List> ini_dists, Nullable<NumericVector> seed, int threads, bool spread);
+RcppExport SEXP _rpathsonpaths_popgen_ibm_replicates(SEXP p_netSEXP, SEXP nSEXP, SEXP ini_distsSEXP, SEXP seedSEXP, SEXP threadsSEXP, SEXP spreadSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const XPtr<Net_t>& >::type p_net(p_netSEXP);
+    Rcpp::traits::input_parameter< int >::type n(nSEXP);
+    Rcpp::traits::input_parameter< Nullable<List> >::type ini_dists(ini_distsSEXP);
+    Rcpp::traits::input_parameter< Nullable<NumericVector> >::type seed(seedSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type spread(spreadSEXP);
+    rcpp_result_gen = Rcpp::wrap(popgen_ibm_replicates(p_net, n, ini_dists, seed, threads, spread));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -233,11 +307,16 @@ static const R_CallMethodDef CallEntries[] = {
     {"_rpathsonpaths_sinks", (DL_FUNC) &_rpathsonpaths_sinks, 1},
     {"_rpathsonpaths_colour_network", (DL_FUNC) &_rpathsonpaths_colour_network, 1},
     {"_rpathsonpaths_cycles", (DL_FUNC) &_rpathsonpaths_cycles, 2},
-    {"_rpathsonpaths_popsnetwork", (DL_FUNC) &_rpathsonpaths_popsnetwork, 6},
+    {"_rpathsonpaths_popsnetwork", (DL_FUNC) &_rpathsonpaths_popsnetwork, 8},
+    {"_rpathsonpaths_change_rates", (DL_FUNC) &_rpathsonpaths_change_rates, 3},
+    {"_rpathsonpaths_fluid_sweep", (DL_FUNC) &_rpathsonpaths_fluid_sweep, 6},
+    {"_rpathsonpaths_source_attribution", (DL_FUNC) &_rpathsonpaths_source_attribution, 2},
+    {"_rpathsonpaths_infection_gradient", (DL_FUNC) &_rpathsonpaths_infection_gradient, 1},
     {"_rpathsonpaths_print_popsnetwork", (DL_FUNC) &_rpathsonpaths_print_popsnetwork, 1},
     {"_rpathsonpaths_set_allele_freqs", (DL_FUNC) &_rpathsonpaths_set_allele_freqs, 2},
-    {"_rpathsonpaths_popgen_dirichlet", (DL_FUNC) &_rpathsonpaths_popgen_dirichlet, 3},
-    {"_rpathsonpaths_popgen_ibm_mixed", (DL_FUNC) &_rpathsonpaths_popgen_ibm_mixed, 2},
+    {"_rpathsonpaths_popgen_dirichlet", (DL_FUNC) &_rpathsonpaths_popgen_dirichlet, 5},
+    {"_rpathsonpaths_popgen_ibm_mixed", (DL_FUNC) &_rpathsonpaths_popgen_ibm_mixed, 4},
+    {"_rpathsonpaths_popgen_ibm_replicates", (DL_FUNC) &_rpathsonpaths_popgen_ibm_replicates, 6},
     {"_rpathsonpaths_draw_isolates", (DL_FUNC) &_rpathsonpaths_draw_isolates, 3},
     {"_rpathsonpaths_draw_alleles", (DL_FUNC) &_rpathsonpaths_draw_alleles, 3},
     {"_rpathsonpaths_edge_list", (DL_FUNC) &_rpathsonpaths_edge_list, 2},
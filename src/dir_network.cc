@@ -4,9 +4,18 @@
 #include "rcpp_util.h"
 #include "rnet_util.h"
 #include "libpathsonpaths/ibmmixed.h"
+#include "libpathsonpaths/threadpool.h"
+#include "libpathsonpaths/dagexec.h"
+#include "libpathsonpaths/transportsoa.h"
+#include "libpathsonpaths/attribution.h"
+#include "libpathsonpaths/adjoint.h"
+#include "libpathsonpaths/replicates.h"
+#include "libpathsonpaths/streamrng.h"
 
 #include <algorithm>
 #include <bitset>
+#include <functional>
+#include <memory>
 
 
 IntegerVector sources(const DataFrame & edge_list)
@@ -131,14 +140,18 @@ SEXP cycles(const DataFrame & edge_list, bool record)
 	}
 
 
-XPtr<Net_t> popsnetwork(const DataFrame & links, const DataFrame & external, 
-	double transmission, double decay, const string & spread_model, bool checks)
+/** Set up network, topology and external inputs from R data (see popsnetwork). 
+ * @tparam NET network type (Net_t or NetF_t).
+ * @param allow_cycles whether checks should accept cycles. */
+template<class NET = Net_t>
+static NET * _build_popsnetwork(const DataFrame & links, const DataFrame & external, 
+	bool checks, bool allow_cycles = false)
 	{
 	// do some slow sanity checks
 	if (checks)
 		{
 		// cycles
-		R_ASSERT(!as<bool>(cycles(links)), "Cycles in network detected");
+		R_ASSERT(allow_cycles || !as<bool>(cycles(links)), "Cycles in network detected");
 
 		// non-empty
 		IntegerVector subn = colour_network(links);
@@ -150,7 +163,7 @@ XPtr<Net_t> popsnetwork(const DataFrame & links, const DataFrame & external,
 			R_ASSERT(c == col, "More than one network in data");
 		}
 
-	Net_t * net = new Net_t;
+	NET * net = new NET;
 
 	R_ASSERT(links.size() > 1, 
 		"At least two columns required in parameter 'links'.");
@@ -186,6 +199,8 @@ XPtr<Net_t> popsnetwork(const DataFrame & links, const DataFrame & external,
 	const size_t ni = inputs.size();
 	for (size_t i=0; i<ni; i++)
 		net->add_link(el.from(i), el.to(i), rates(i));
+	// set up adjacency
+	net->build();
 
 // *** external inputs
 	if (el.factor())
@@ -200,8 +215,10 @@ XPtr<Net_t> popsnetwork(const DataFrame & links, const DataFrame & external,
 			}
 
 		// TODO not pretty, should be done better
-		swap(el.idxs(), net->id_by_name);
-		swap(el.names(), net->name_by_id);
+		auto names = make_shared<NodeNames>();
+		swap(el.idxs(), names->id_by_name);
+		swap(el.names(), names->name_by_id);
+		net->names = names;
 		// !!! el is empty below this line !!!
 		}
 	else
@@ -216,21 +233,105 @@ XPtr<Net_t> popsnetwork(const DataFrame & links, const DataFrame & external,
 			stop("Invalid node id in input specification.");
 			}
 
-	// check for gaps in ids
+	// check for gaps in ids (they show up as unconnected nodes)
 	for (const auto & n : net->nodes)
-		R_ASSERT(n != 0, "Invalid network, nodes missing.");
+		R_ASSERT(!(n->is_root() && n->is_leaf()), "Invalid network, nodes missing.");
+
+	return net;
+	}
+
+
+/** Call @a func for all nodes of an acyclic network, every node after its inputs. 
+ * Parallel sweeps process a node as soon as all its inputs are done, which gives the 
+ * same result as a serial sweep for kernels that only depend on their inputs (and on 
+ * per-node random number streams). */
+static void _sweep(Net_t & net, int threads, const std::function<void(Node_t *)> & func)
+	{
+	// the executor would throw as well, but only after processing part of the network
+	R_ASSERT(net.acyclic(), "Cycles in network detected.");
+
+	// the serial sweep has better memory locality, so we only use the executor if
+	// there is more than one thread
+	if (threads > 1)
+		DAGExecutor(threads).run(net.nodes, func);
+	else
+		for (auto n : net.topological_order())
+			func(n);
+	}
+
+
+XPtr<Net_t> popsnetwork(const DataFrame & links, const DataFrame & external, 
+	double transmission, double decay, const string & spread_model, bool checks, 
+	int threads, Nullable<NumericVector> seed)
+	{
+	R_ASSERT(threads > 0, "Number of threads has to be at least 1.");
+
+	// the fluid model can deal with cycles
+	Net_t * net = _build_popsnetwork(links, external, checks, spread_model == "fluid");
+	net->spread_model = spread_model;
+	net->transmission = transmission;
+	net->decay = decay;
 
-	// this interpolates transfer rates
-	if (decay >= 0.0 && decay < 1.0)
-		preserve_mass(net->nodes.begin(), net->nodes.end(), decay);
+	auto sweep = [net, threads](const std::function<void(Node_t *)> & func)
+		{
+		_sweep(*net, threads, func);
+		};
 
 // *** generate rate of infectedness for all nodes
+	// interpolation of transfer rates (if decay is in [0, 1)) and infection are done
+	// in the same visit
 	if (spread_model== "fluid")
-		annotate_rates(net->nodes.begin(), net->nodes.end(), transmission);
+		{
+		// rescaling overwrites the rates, change_rates needs the original ones
+		if (decay >= 0.0 && decay < 1.0)
+			net->keep_rates();
+
+		if (net->acyclic())
+			{
+			const auto kernel = [decay, transmission](Node_t * n)
+				{preserve_mass_annotate_rates(n, decay, transmission);};
+
+			// nodes within a topological level are independent, so they can be
+			// processed in parallel without changing the result
+			if (threads > 1)
+				{
+				ThreadPool pool(threads);
+				parallel_levels(net->topological_order(), net->level_offsets(), pool, 
+					kernel);
+				}
+			else
+				sweep(kernel);
+			}
+		// cycles are solved per component (single-threaded)
+		else
+			net->solve_fluid(transmission, decay);
+		}
 	else if (spread_model == "units")
 		{
-		Rng rng;
-		annotate_rates_ibmm(net->nodes.begin(), net->nodes.end(), transmission, rng);
+		R_ASSERT(net->acyclic(), "Cycles in network detected, only the fluid model "
+			"supports cycles.");
+
+		// this interpolates transfer rates
+		if (decay >= 0.0 && decay < 1.0)
+			sweep([decay](Node_t * n){preserve_mass(n, decay);});
+
+		// one random number stream per node, can run in parallel
+		if (!seed.isNull())
+			{
+			const uint64_t s = stream_seed(seed);
+			sweep([s, transmission](Node_t * n)
+				{
+				StreamRng rng(s, n->id, STREAMS_SPREAD);
+				annotate_rates_ibmm(n, transmission, rng);
+				});
+			}
+		// R's rng has to run single-threaded
+		else
+			{
+			const auto & order = net->topological_order();
+			Rng rng;
+			annotate_rates_ibmm(order.begin(), order.end(), transmission, rng);
+			}
 		}
 	else
 		stop("Unknown spread model.");
@@ -239,6 +340,305 @@ XPtr<Net_t> popsnetwork(const DataFrame & links, const DataFrame & external,
 	}
 
 
+XPtr<Net_t> change_rates(const XPtr<Net_t> & p_net, Nullable<DataFrame> links, 
+	Nullable<DataFrame> external)
+	{
+	Net_t * net = p_net.checked_get();
+
+	R_ASSERT(net->spread_model == "fluid", "Only the fluid model supports updates.");
+
+	const bool f = net->name_by_id().size();
+
+	// nodes whose input or outputs changed
+	vector<Node_t *> dirty;
+
+	// roots that are processed again have to get their preset input back (without
+	// transmission, see reset_source), this can be done repeatedly
+	auto reset_root = [net](Node_t * n)
+		{
+		if (n->is_root())
+			net->reset_source(n->id);
+		};
+
+	if (! links.isNull())
+		{
+		const DataFrame l = links.as();
+		R_ASSERT(l.size() > 2, "Three columns required in parameter 'links'.");
+
+		const IntegerVector inputs = l(0);
+		const IntegerVector outputs = l(1);
+		const NumericVector rates = l(2);
+
+		R_ASSERT(inputs.inherits("factor") == f && outputs.inherits("factor") == f,
+			"Node ids have to be of the same type as in the network.");
+
+		const StringVector i_levels = f ? inputs.attr("levels") : StringVector();
+		const StringVector o_levels = f ? outputs.attr("levels") : StringVector();
+
+		for (size_t i=0; i<inputs.size(); i++)
+			{
+			const size_t from = f ? 
+				net->id_by_name().at(string(i_levels(inputs(i)-1))) : inputs[i];
+			const size_t to = f ? 
+				net->id_by_name().at(string(o_levels(outputs(i)-1))) : outputs[i];
+
+			R_ASSERT(from < net->nodes.size() && to < net->nodes.size(), 
+				"Invalid node index");
+			R_ASSERT(rates[i] >= 0, "Rates can not be negative.");
+
+			Link_t * link = net->nodes[from]->find_link_to(net->nodes[to]);
+			R_ASSERT(link, "Link not found.");
+
+			// with rescaling this replaces the link's original rate, the rates of
+			// all affected nodes are rescaled from their original rates again
+			net->set_rate(link->id, rates[i]);
+
+			// the infected rates of all outputs of the start node change (and with
+			// rescaling their rates as well), so it has to be processed again
+			reset_root(net->nodes[from]);
+			dirty.push_back(net->nodes[from]);
+			}
+		}
+
+	if (! external.isNull())
+		{
+		const DataFrame e = external.as();
+		R_ASSERT(e.size() > 1, "At least two columns required in parameter 'external'."); 
+
+		const IntegerVector nodes = e(0);
+		const NumericVector rates_infd = e(1);
+		const bool has_inp_rates = e.size() > 2;
+		const NumericVector rates_inp = has_inp_rates ? e(2) : NumericVector();
+
+		R_ASSERT(nodes.inherits("factor") == f, 
+			"Node ids have to be of the same type as in the network.");
+
+		const StringVector levels = f ? nodes.attr("levels") : StringVector();
+
+		for (size_t i=0; i<nodes.size(); i++)
+			{
+			const size_t n = f ? 
+				net->id_by_name().at(string(levels(nodes(i)-1))) : nodes[i];
+
+			R_ASSERT(n < net->nodes.size(), "Invalid node index");
+
+			Node_t * node = net->nodes[n];
+			R_ASSERT(node->is_root(), "Only nodes without inputs can be sources.");
+
+			const double inp = has_inp_rates ? rates_inp[i] : node->rate_in;
+			R_ASSERT(rates_infd[i] <= inp, 
+				"input of infected material larger than overall input");
+
+			net->set_source(n, rates_infd[i], inp);
+			dirty.push_back(node);
+			}
+		}
+
+	// only the part downstream of the changes needs to be recalculated, unless it 
+	// contains cycles
+	if (net->acyclic())
+		net->update_downstream(dirty.begin(), dirty.end(), net->transmission, net->decay);
+	else
+		{
+		for (auto n : net->nodes)
+			reset_root(n);
+		net->solve_fluid(net->transmission, net->decay);
+		}
+
+	return p_net;
+	}
+
+
+/** Implementation of fluid_sweep for network type @a NET and batch precision @a REAL. */
+template<class NET, class REAL>
+static NumericMatrix _fluid_sweep(const DataFrame & links, const DataFrame & external, 
+	const NumericVector & transmission, const NumericVector & decay, bool checks)
+	{
+	unique_ptr<NET> net(_build_popsnetwork<NET>(links, external, checks));
+
+	R_ASSERT(net->acyclic(), "Cycles in network detected, fluid_sweep needs a network "
+		"without cycles.");
+	const auto & order = net->topological_order();
+
+	// with a single decay value all runs share the same transfer rates
+	const bool per_run_decay = decay.size() > 1;
+	if (per_run_decay)
+		for (double d : decay)
+			R_ASSERT(d >= 0.0 && d < 1.0, "Decay values have to be in [0, 1).");
+	else if (decay[0] >= 0.0 && decay[0] < 1.0)
+		preserve_mass(order.begin(), order.end(), decay[0]);
+
+	const size_t n_nodes = net->nodes.size();
+	const size_t n_runs = transmission.size();
+	NumericMatrix res(n_nodes, n_runs);
+
+	// memory use of the batch grows with its width, so we do at most this many
+	// runs at a time 
+	const size_t max_width = 64;
+	TranspBatch<REAL> batch;
+
+	for (size_t b=0; b<n_runs; b+=max_width)
+		{
+		const size_t w = min(max_width, n_runs-b);
+		const vector<double> transm(transmission.begin()+b, transmission.begin()+b+w);
+
+		batch.load(*net, w, !per_run_decay);
+
+		if (per_run_decay)
+			preserve_mass(net->topology(), batch, 
+				vector<double>(decay.begin()+b, decay.begin()+b+w));
+
+		annotate_rates(net->topology(), batch, transm);
+
+		for (size_t i=0; i<n_nodes; i++)
+			for (size_t k=0; k<w; k++)
+				res(i, b+k) = batch.prop_infected(i, k);
+		}
+
+	// row names, see distances_topology
+	StringVector rn(n_nodes);
+	if (net->name_by_id().size())
+		rn = net->name_by_id();
+	else
+		for (size_t i=0; i<n_nodes; i++)
+			rn(i) = to_string(i);
+	rownames(res) = rn;
+
+	return res;
+	}
+
+
+NumericMatrix fluid_sweep(const DataFrame & links, const DataFrame & external, 
+	const NumericVector & transmission, const NumericVector & decay, bool checks,
+	const string & precision)
+	{
+	R_ASSERT(transmission.size() > 0, "At least one transmission rate required.");
+	R_ASSERT(decay.size() == 1 || decay.size() == transmission.size(), 
+		"'decay' has to be a single value or one value per transmission rate.");
+
+	if (precision == "double")
+		return _fluid_sweep<Net_t, double>(links, external, transmission, decay, checks);
+	else if (precision == "single")
+		return _fluid_sweep<NetF_t, float>(links, external, transmission, decay, checks);
+
+	stop("Unknown precision.");
+	return NumericMatrix();
+	}
+
+
+SEXP source_attribution(const XPtr<Net_t> & p_net, bool sparse)
+	{
+	// not const, the topological order is cached on first use
+	Net_t * net = p_net.checked_get();
+
+	R_ASSERT(net->spread_model == "fluid", "Only the fluid model supports attribution.");
+	R_ASSERT(net->acyclic(), "Cycles in network detected, attribution needs a network "
+		"without cycles.");
+
+	// rates are up to date, so one pass is enough
+	const auto & order = net->topological_order();
+	SourceAttribution attr;
+	attr.init(net->nodes);
+	attr.add(order.begin(), order.end());
+
+	const size_t n_nodes = net->nodes.size();
+	const size_t n_src = attr.n_sources();
+	const bool is_factor = net->name_by_id().size();
+
+	if (sparse)
+		{
+		const size_t n_entries = attr.n_entries();
+		IntegerVector node(n_entries), source(n_entries);
+		NumericVector infected(n_entries);
+
+		size_t e = 0;
+		for (size_t i=0; i<n_nodes; i++)
+			for (size_t j=0; j<attr.size(i); j++, e++)
+				{
+				const size_t s = attr.source(i, j);
+				node[e] = is_factor ? i+1 : i;
+				// transmission within nodes
+				if (s == n_src)
+					source[e] = NA_INTEGER;
+				else
+					source[e] = is_factor ? attr.source(s)+1 : attr.source(s);
+				infected[e] = attr.value(i, j);
+				}
+
+		if (is_factor)
+			{
+			node.attr("class") = "factor";
+			node.attr("levels") = net->name_by_id();
+			source.attr("class") = "factor";
+			source.attr("levels") = net->name_by_id();
+			}
+
+		return DataFrame::create(Named("node") = node, Named("source") = source,
+			Named("infected") = infected);
+		}
+
+	NumericMatrix res(n_nodes, n_src+1);
+	for (size_t i=0; i<n_nodes; i++)
+		for (size_t j=0; j<attr.size(i); j++)
+			res(i, attr.source(i, j)) = attr.value(i, j);
+
+	// col/row names, see distances_topology
+	StringVector cn(n_src+1), rn(n_nodes);
+	for (size_t i=0; i<n_nodes; i++)
+		rn(i) = is_factor ? net->name_by_id()[i] : to_string(i);
+	for (size_t s=0; s<n_src; s++)
+		cn(s) = is_factor ? net->name_by_id()[attr.source(s)] : to_string(attr.source(s));
+	cn(n_src) = "transmission";
+
+	colnames(res) = cn;
+	rownames(res) = rn;
+
+	return res;
+	}
+
+
+List infection_gradient(const XPtr<Net_t> & p_net)
+	{
+	// not const, the topological order is cached on first use
+	Net_t * net = p_net.checked_get();
+
+	R_ASSERT(net->spread_model == "fluid", "Only the fluid model supports gradients.");
+	R_ASSERT(net->acyclic(), "Cycles in network detected, gradients need a network "
+		"without cycles.");
+
+	vector<double> d_rate, d_infd, d_in;
+	fluid_gradient(*net, net->decay, net->transmission, d_rate, d_infd, d_in);
+
+	// sources
+	vector<size_t> sources;
+	for (auto n : net->nodes)
+		if (n->is_root())
+			sources.push_back(n->id);
+
+	const bool is_factor = net->name_by_id().size();
+	IntegerVector node(sources.size());
+	NumericVector infected(sources.size()), input(sources.size());
+
+	for (size_t i=0; i<sources.size(); i++)
+		{
+		const size_t s = sources[i];
+		node[i] = is_factor ? s+1 : s;
+		infected[i] = d_infd[s];
+		input[i] = d_in[s];
+		}
+
+	if (is_factor)
+		{
+		node.attr("class") = "factor";
+		node.attr("levels") = net->name_by_id();
+		}
+
+	return List::create(Named("links") = NumericVector(d_rate.begin(), d_rate.end()), 
+		Named("sources") = DataFrame::create(Named("node") = node, 
+			Named("infected") = infected, Named("input") = input));
+	}
+
+
 void print_popsnetwork(const XPtr<Net_t> & p_net)
 	{
 	const Net_t * net = p_net.checked_get();
@@ -251,8 +651,8 @@ void print_popsnetwork(const XPtr<Net_t> & p_net)
 		print_node_id(net, i); Rcout  << "\t" <<
 			(n.rate_in <= 0 ? 0 : n.rate_in_infd/n.rate_in) << "\t" <<
 			n.rate_in;
-		for (auto f : n.frequencies)
-			Rcout << "\t" << f;
+		for (size_t a=0; a<n.frequencies.size(); a++)
+			Rcout << "\t" << n.frequencies[a];
 		Rcout << "\n";
 		}
 	Rcout << "\n";
@@ -261,8 +661,8 @@ void print_popsnetwork(const XPtr<Net_t> & p_net)
 	for (size_t i=0; i<net->links.size(); i++)
 		{
 		Link_t & l = *net->links[i];
-		size_t f = net->find_node_id(l.from);
-		size_t t = net->find_node_id(l.to);
+		const size_t f = l.from->id;
+		const size_t t = l.to->id;
 		print_node_id(net, f); Rcout  << "\t";
 		print_node_id(net, t); Rcout << "\t" <<
 			l.rate << "\t" <<
@@ -281,8 +681,14 @@ XPtr<Net_t> set_allele_freqs(const XPtr<Net_t> & p_net, const List & iniDist)
 	}
 
 
-XPtr<Net_t> popgen_dirichlet(const XPtr<Net_t> & p_net, double theta, Nullable<List> iniDist)
+XPtr<Net_t> popgen_dirichlet(const XPtr<Net_t> & p_net, double theta, Nullable<List> iniDist,
+	Nullable<NumericVector> seed, int threads)
 	{
+	R_ASSERT(threads > 0, "Number of threads has to be at least 1.");
+	// fluid networks can have cycles, genetics are simulated in topological order
+	R_ASSERT(p_net.checked_get()->acyclic(), "Cycles in network detected, genetic "
+		"simulations need a network without cycles.");
+
 	Net_t * net = new Net_t(*p_net.checked_get());
 
 	if (! iniDist.isNull())
@@ -295,15 +701,38 @@ XPtr<Net_t> popgen_dirichlet(const XPtr<Net_t> & p_net, double theta, Nullable<L
 	R_ASSERT(n_all, "No genetic data in network.");
 
 	// simulate
-	Drift drift(theta);
-	annotate_frequencies(net->nodes.begin(), net->nodes.end(), drift);
+	if (!seed.isNull())
+		{
+		const uint64_t s = stream_seed(seed);
+		// nodes pull from their inputs in a fixed order, so that results don't depend
+		// on scheduling
+		_sweep(*net, threads, [s, theta](Node_t * n)
+			{
+			StreamRng rng(s, n->id, STREAMS_DIRICHLET);
+			Drift<StreamRng> drift(theta, rng);
+			annotate_frequencies(n, drift);
+			});
+		}
+	else
+		{
+		Rng rng;
+		Drift<Rng> drift(theta, rng);
+		const auto & order = net->topological_order();
+		annotate_frequencies(order.begin(), order.end(), drift);
+		}
 	
 	return make_S3XPtr(net, "popsnetwork", true);
 	}
 
 
-XPtr<Net_t> popgen_ibm_mixed(const XPtr<Net_t> & p_net, Nullable<List> iniDist)
+XPtr<Net_t> popgen_ibm_mixed(const XPtr<Net_t> & p_net, Nullable<List> iniDist,
+	Nullable<NumericVector> seed, int threads)
 	{
+	R_ASSERT(threads > 0, "Number of threads has to be at least 1.");
+	// fluid networks can have cycles, genetics are simulated in topological order
+	R_ASSERT(p_net.checked_get()->acyclic(), "Cycles in network detected, genetic "
+		"simulations need a network without cycles.");
+
 	Net_t * net = new Net_t(*p_net.checked_get());
 
 	if (! iniDist.isNull())
@@ -315,19 +744,76 @@ XPtr<Net_t> popgen_ibm_mixed(const XPtr<Net_t> & p_net, Nullable<List> iniDist)
 
 	R_ASSERT(n_all, "No genetic data in network.");
 
-	Rng rng;
-	// scale frequencies to absolute numbers
-	freq_to_popsize_ibmm(net->nodes.begin(), net->nodes.end(), rng);
-	// simulate
-	annotate_frequencies_ibmm(net->nodes.begin(), net->nodes.end(), rng);
-	// scale back to frequencies
-	for (auto node : net->nodes)
-		node->normalize();
+	// frequencies -> absolute numbers -> simulation -> frequencies
+	if (!seed.isNull())
+		{
+		const uint64_t s = stream_seed(seed);
+		NodeLocks locks;
+		_sweep(*net, threads, [s, &locks](Node_t * n)
+			{
+			StreamRng rng(s, n->id, STREAMS_IBM);
+			genetics_ibmm(n, rng, locks);
+			});
+		}
+	else
+		{
+		Rng rng;
+		simulate_genetics_ibmm(*net, rng);
+		}
 	
 	return make_S3XPtr(net, "popsnetwork", true);
 	}
 
 
+List popgen_ibm_replicates(const XPtr<Net_t> & p_net, int n, Nullable<List> ini_dists,
+	Nullable<NumericVector> seed, int threads, bool spread)
+	{
+	R_ASSERT(n >= 0, "Number of replicates can not be negative.");
+	R_ASSERT(threads > 0, "Number of threads has to be at least 1.");
+
+	const Net_t * net = p_net.checked_get();
+	R_ASSERT(net->nodes.size(), "Empty network");
+	R_ASSERT(net->acyclic(), "Cycles in network detected, genetic simulations need a "
+		"network without cycles.");
+	R_ASSERT(!spread || net->spread_model == "units", 
+		"Only the units model supports a new spread per replicate.");
+
+	const List inis = ini_dists.isNull() ? List() : List(ini_dists.as());
+
+	// a single seed covers all replicates, by default it comes from R's rng
+	const uint64_t s = stream_seed(seed);
+
+	// copies are set up here since initialization needs R, they are handed over to 
+	// R right away so that nothing leaks if something goes wrong
+	vector<Net_t *> reps(n);
+	List res(n);
+	for (int i=0; i<n; i++)
+		{
+		reps[i] = new Net_t(*net);
+		res[i] = make_S3XPtr(reps[i], "popsnetwork", true);
+
+		if (inis.size())
+			_set_allele_freqs(reps[i], inis[i % inis.size()]);
+
+		R_ASSERT(reps[i]->nodes[0]->frequencies.size(), "No genetic data in network.");
+		}
+
+	// no calls into R from here on
+	ReplicateRunner runner(threads, s);
+	const double transmission = net->transmission;
+	runner.run(n, [&reps, spread, transmission](size_t i, StreamRng & rng)
+		{
+		// spread and genetics in one traversal
+		if (spread)
+			simulate_ibmm(*reps[i], transmission, rng);
+		else
+			simulate_genetics_ibmm(*reps[i], rng);
+		});
+
+	return res;
+	}
+
+
 DataFrame draw_isolates(const XPtr<Net_t> & p_net, const DataFrame & samples, bool aggregate)
 	{
 	const Net_t * net = p_net.checked_get();
@@ -383,7 +869,7 @@ DataFrame draw_isolates(const XPtr<Net_t> & p_net, const DataFrame & samples, bo
 
 	for (size_t i=0; i<nodes.size(); i++)
 		{
-		const size_t n = f ? net->id_by_name.at(string(levels[nodes[i]-1])):
+		const size_t n = f ? net->id_by_name().at(string(levels[nodes[i]-1])):
 			nodes[i];
 		R_ASSERT (n < net->nodes.size(), "Invalid node id");
 
@@ -466,7 +952,7 @@ DataFrame draw_alleles(const XPtr<Net_t> & p_net, const IntegerVector & nodes, i
 
 	for (size_t i=0; i<nodes.size(); i++)
 		{
-		const size_t nid = f ? net->id_by_name.at(string(levels[nodes[i]-1])):
+		const size_t nid = f ? net->id_by_name().at(string(levels[nodes[i]-1])):
 			nodes[i];
 
 		R_ASSERT(nid < net->nodes.size(), "Invalid node id");
@@ -508,7 +994,7 @@ DataFrame edge_list(const XPtr<Net_t> & p_net, bool as_string)
 	NumericVector rates_i(n_links);
 
 	// do we have names?
-	const bool is_factor = net->name_by_id.size();
+	const bool is_factor = net->name_by_id().size();
 
 	const size_t n_nodes = net->nodes.size();
 
@@ -519,15 +1005,15 @@ DataFrame edge_list(const XPtr<Net_t> & p_net, bool as_string)
 
 		R_ASSERT(l, "Missing link detected");
 
-		const size_t f = net->find_node_id(l->from);
-		const size_t t = net->find_node_id(l->to);
+		const size_t f = l->from->id;
+		const size_t t = l->to->id;
 
-		R_ASSERT(f!=n_nodes && t!=n_nodes, "Invalid link");
+		R_ASSERT(f<n_nodes && t<n_nodes, "Invalid link");
 
 		if (as_string)
 			{
-			from_s[i] = is_factor ? net->name_by_id[f] : to_string(f);
-			to_s[i] = is_factor ? net->name_by_id[t] : to_string(t);
+			from_s[i] = is_factor ? net->name_by_id()[f] : to_string(f);
+			to_s[i] = is_factor ? net->name_by_id()[t] : to_string(t);
 			}
 		else
 			{
@@ -551,9 +1037,9 @@ DataFrame edge_list(const XPtr<Net_t> & p_net, bool as_string)
 	if (is_factor)
 		{
 		from_i.attr("class") = "factor";
-		from_i.attr("levels") = net->name_by_id;
+		from_i.attr("levels") = net->name_by_id();
 		to_i.attr("class") = "factor";
-		to_i.attr("levels") = net->name_by_id;
+		to_i.attr("levels") = net->name_by_id();
 		}
 
 	return DataFrame::create(
@@ -572,14 +1058,14 @@ DataFrame node_list(const XPtr<Net_t> & p_net, bool as_string)
 	IntegerVector id_i(as_string ? 0 : net->nodes.size());
 	NumericVector inf(net->nodes.size());
 
-	const bool is_factor = net->name_by_id.size();
+	const bool is_factor = net->name_by_id().size();
 
 	for (size_t i=0; i<net->nodes.size(); i++)
 		{
 		const Node_t * n = net->nodes[i];
 
 		if (as_string)
-			id_s[i] = is_factor ? net->name_by_id[i] : to_string(i);
+			id_s[i] = is_factor ? net->name_by_id()[i] : to_string(i);
 		else
 			id_i[i] = is_factor ? i+1 : i;
 
@@ -592,7 +1078,7 @@ DataFrame node_list(const XPtr<Net_t> & p_net, bool as_string)
 	if (is_factor)
 		{
 		id_i.attr("class") = "factor";
-		id_i.attr("levels") = net->name_by_id;
+		id_i.attr("levels") = net->name_by_id();
 		}
 
 	return DataFrame::create(Named("id") = id_i, Named("infected") = inf);
@@ -612,11 +1098,11 @@ NumericMatrix distances_topology(const XPtr<Net_t> & p_net)
 	// col/row names
 	StringVector cn(net->nodes.size()), rn(net->nodes.size());
 
-	if (net->name_by_id.size())		// factor
+	if (net->name_by_id().size())		// factor
 		{
 		// StringVector is clearly missing a constructor here
-		cn = net->name_by_id;
-		rn = net->name_by_id;
+		cn = net->name_by_id();
+		rn = net->name_by_id();
 		}
 	// we need to name cols and rows even for non-factors, otherwise
 	// subscripting won't work (0-based vs. 1-based)
@@ -673,11 +1159,11 @@ NumericMatrix distances_sample(const XPtr<Net_t> & p_net, int n, bool skip_empty
 	// col/row names
 	StringVector cn(net->nodes.size()), rn(net->nodes.size());
 
-	if (net->name_by_id.size())		// factor
+	if (net->name_by_id().size())		// factor
 		{
 		// StringVector is clearly missing a constructor here
-		cn = net->name_by_id;
-		rn = net->name_by_id;
+		cn = net->name_by_id();
+		rn = net->name_by_id();
 		}
 	// we need to name cols and rows even for non-factors, otherwise
 	// subscripting won't work (0-based vs. 1-based)
@@ -707,12 +1193,12 @@ NumericMatrix distances_freqdist(const XPtr<Net_t> & p_net, bool skip_empty)
 					(net->nodes[i]->rate_in_infd <= 0 || net->nodes[j]->rate_in_infd <= 0) ? 
 				NA_REAL : distance_freq(*net->nodes[i], *net->nodes[j]);
 
-	if (net->name_by_id.size())
+	if (net->name_by_id().size())
 		{
 		// StringVector is clearly missing a constructor here
-		StringVector cn(net->name_by_id.size()), rn(net->name_by_id.size());
-		cn = net->name_by_id;
-		rn = net->name_by_id;
+		StringVector cn(net->name_by_id().size()), rn(net->name_by_id().size());
+		cn = net->name_by_id();
+		rn = net->name_by_id();
 		colnames(res) = cn;
 		rownames(res) = rn;
 		}
@@ -738,11 +1224,11 @@ NumericMatrix distances_EHamming(const XPtr<Net_t> & p_net, bool skip_empty)
 
 	StringVector cn(net->nodes.size()), rn(net->nodes.size());
 
-	if (net->name_by_id.size())
+	if (net->name_by_id().size())
 		{
 		// StringVector is clearly missing a constructor here
-		cn = net->name_by_id;
-		rn = net->name_by_id;
+		cn = net->name_by_id();
+		rn = net->name_by_id();
 		}
 	// we need to name cols and rows even for non-factors, otherwise
 	// subscripting won't work (0-based vs. 1-based)
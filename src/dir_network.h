@@ -163,11 +163,154 @@ SEXP cycles(const DataFrame & edge_list, bool record=false);
 //' the infection and the pathogen itself is essentially treated as a fluid and rates are 
 //' calculated deterministically. With "units" infection as well as selection of infected vs.
 //' uninfected material at outputs is modelled as a stochastic process on discrete units.
+//' Only the "fluid" model supports networks with cycles. Rates within cycles are 
+//' calculated by solving a linear system per cycle, this requires that material does not 
+//' circulate forever (i.e. there has to be decay or some output leaving the cycle).
 //' @param checks Perform some basic integrity checks on input data (currently looks for cycles
-//' and disconnected sub-networks).
+//' (except for the "fluid" model) and disconnected sub-networks).
+//' @param threads Number of threads to use. Mass preservation and the "fluid" 
+//' model can make use of more than one thread (cycles are always solved on a single thread),
+//' the "units" model only if \code{seed} is set. Results do not depend on the number of 
+//' threads.
+//' @param seed Seed for the "units" model. If set, every node draws from its own random
+//' number stream, derived from \code{seed} and the node's index, instead of R's random 
+//' number generator. Streams of different functions are independent, the same seed can
+//' be used for all of them.
 //' @return A popsnetwork object.
 // [[Rcpp::export]]
-XPtr<Net_t> popsnetwork(const DataFrame & links, const DataFrame & external, double transmission=0.0, double decay=-1.0, const string & spread_model = "fluid", bool checks=false);
+XPtr<Net_t> popsnetwork(const DataFrame & links, const DataFrame & external, double transmission=0.0, double decay=-1.0, const string & spread_model = "fluid", bool checks=false, int threads=1, Nullable<NumericVector> seed = R_NilValue);
+
+
+//' @title change_rates
+//'
+//' @description Change transfer rates or external inputs of a network in place.
+//'
+//' @details Sets new rates for some links and/or new inputs for some source nodes and
+//' recalculates the spread of infection. Only the part of the network downstream of the
+//' changes is recalculated, which makes this considerably faster than creating a new
+//' network for small changes (networks with cycles are recalculated entirely). The 
+//' result is the same as calling \code{\link{popsnetwork}} with the links the network 
+//' was created with (including earlier changes) and the changed rates and inputs (using 
+//' the same transmission rate and decay). Note that \code{p_net} is modified, not 
+//' copied. 
+//' Only available for the "fluid" model.
+//'
+//' @param p_net A popsnetwork object.
+//' @param links A dataframe with three columns (from, to, rate) containing new transfer 
+//' rates for existing links, replacing the rates they were created with. If the network
+//' was created with rescaling (see \code{decay} in \code{\link{popsnetwork}}) the 
+//' outputs of all affected nodes are rescaled again from their original rates, i.e. new 
+//' rates are on the same scale as the ones passed to \code{\link{popsnetwork}}, not as
+//' the current (rescaled) ones (see \code{\link{edge_list}}).
+//' @param external A dataframe with new external inputs (see \code{\link{popsnetwork}}).
+//' Only nodes without inputs can be sources. If there is no third column the overall 
+//' input rates of the nodes are kept.
+//' @return The modified popsnetwork object.
+//'
+//' @examples
+//' el <- data.frame(from=c("A", "B", "C"), to=c("C", "C", "D"), rates=c(1.5, 1, 3))
+//' ext <- data.frame(node=c("A", "B"), rate=c(0.3, 0.1))
+//' net <- popsnetwork(el, ext, 0.1)
+//' change_rates(net, external=data.frame(node=factor("B"), rate=0.5))
+//' node_list(net)
+// [[Rcpp::export]]
+XPtr<Net_t> change_rates(const XPtr<Net_t> & p_net, Nullable<DataFrame> links=R_NilValue, Nullable<DataFrame> external=R_NilValue);
+
+
+//' @title fluid_sweep
+//'
+//' @description Run the fluid model for many transmission rates at once.
+//'
+//' @details Equivalent to calling \code{\link{popsnetwork}} with 
+//' \code{spread_model="fluid"} for every value of \code{transmission} (and 
+//' \code{decay}) and collecting the proportion of infected material in each node, but
+//' the network is only set up once and all values are processed in a single pass 
+//' through the network.
+//'
+//' @param links A dataframe describing all edges in the graph (see 
+//' \code{\link{popsnetwork}}).
+//' @param external A dataframe describing external inputs into the network (see 
+//' \code{\link{popsnetwork}}).
+//' @param transmission A vector of rates of infection within nodes.
+//' @param decay The decay of material within nodes. Either a single value that is used
+//' for all runs (see \code{\link{popsnetwork}}) or one value in [0, 1) per 
+//' transmission rate.
+//' @param checks Perform some basic integrity checks on input data (see
+//' \code{\link{popsnetwork}}).
+//' @param precision Floating point precision used for rates, either "double" or "single".
+//' Single precision needs half the memory and is faster for large networks, results 
+//' differ from double precision by roughly 1e-6 (relative).
+//' @return A matrix with one row per node (named by node id) and one column per 
+//' transmission rate, containing the proportion of infected material.
+//'
+//' @examples
+//' el <- data.frame(from=c("A", "B", "C"), to=c("C", "C", "D"), rates=c(1.5, 1, 3))
+//' ext <- data.frame(node=c("A", "B"), rate=c(0.3, 0.1))
+//' fluid_sweep(el, ext, seq(0, 1, 0.1))
+// [[Rcpp::export]]
+NumericMatrix fluid_sweep(const DataFrame & links, const DataFrame & external, const NumericVector & transmission, const NumericVector & decay=NumericVector::create(-1.0), bool checks=false, const string & precision="double");
+
+
+//' @title source_attribution
+//'
+//' @description Attribute infected material in each node to the sources it came from.
+//'
+//' @details In the fluid model infected material is passed on in proportion to 
+//' transfer rates. The infected material in a node can therefore be split up by the 
+//' source node (i.e. node without inputs) it originally came from. Material that 
+//' became infected within nodes (see \code{transmission} in \code{\link{popsnetwork}})
+//' is counted separately. Contributions of a node add up to the amount of infected
+//' material it contains (see \code{\link{node_list}}). All contributions are calculated 
+//' in a single pass through the network.
+//'
+//' @param p_net A popsnetwork object (using the "fluid" model).
+//' @param sparse Whether to return a long format dataframe containing only non-zero
+//' contributions instead of a matrix. Useful for large networks where each node is only
+//' reached by a few sources.
+//' @return Either a matrix with one row per node and one column per source plus a 
+//' column "transmission" or a dataframe with columns node, source (NA for transmission)
+//' and infected.
+//'
+//' @examples
+//' el <- data.frame(from=c("A", "B", "C"), to=c("C", "C", "D"), rates=c(1.5, 1, 3))
+//' ext <- data.frame(node=c("A", "B"), rate=c(0.3, 0.1))
+//' net <- popsnetwork(el, ext, 0.1)
+//' source_attribution(net)
+//' source_attribution(net, sparse=TRUE)
+// [[Rcpp::export]]
+SEXP source_attribution(const XPtr<Net_t> & p_net, bool sparse=false);
+
+
+//' @title infection_gradient
+//'
+//' @description Sensitivity of infection to transfer rates and external inputs.
+//'
+//' @details Calculates the derivative of the overall amount of infected material 
+//' arriving in sinks (nodes without outputs) with respect to every link rate and 
+//' every external input. All derivatives are obtained in a single backwards pass
+//' through the network (reverse-mode differentiation), which is much faster than 
+//' changing parameters one at a time. 
+//'
+//' Derivatives with respect to link rates are relative to the current rates (see 
+//' \code{\link{edge_list}}) and include the effect of rescaling (see \code{decay} in
+//' \code{\link{popsnetwork}}), i.e. they describe the effect of 
+//' \code{\link{change_rates}}. Infection within a node only starts if it receives any 
+//' infected material, the resulting jump for nodes without infected input is 
+//' ignored. Only available for the "fluid" model.
+//'
+//' @param p_net A popsnetwork object.
+//' @return A list with elements \code{links}, a vector of derivatives by link rate in 
+//' the same order as \code{\link{edge_list}}, and \code{sources}, a dataframe with the
+//' derivatives by infected input (\code{infected}) and overall input (\code{input}) 
+//' of all source nodes.
+//'
+//' @examples
+//' el <- data.frame(from=c("A", "B", "C"), to=c("C", "C", "D"), rates=c(1.5, 1, 3))
+//' ext <- data.frame(node=c("A", "B"), rate=c(0.3, 0.1))
+//' net <- popsnetwork(el, ext, 0.1, 0.1)
+//' infection_gradient(net)
+// [[Rcpp::export]]
+List infection_gradient(const XPtr<Net_t> & p_net);
 
 
 // [[Rcpp::export(name=".printpopsnetwork")]]
@@ -222,6 +365,12 @@ XPtr<Net_t> set_allele_freqs(const XPtr<Net_t> & p_net, const List & ini_dist);
 //' a matrix of allele frequencies. Note that *any* node pre-set in this
 //' way will effectively be treated as a source and hide nodes that are further upstream (see
 //' \code{\link{set_allele_freqs}}).
+//' @param seed Seed for random number streams (optional). If set, every node draws from 
+//' its own stream, derived from \code{seed} and the node's index, instead of R's random
+//' number generator. Streams of different functions are independent, the same seed can
+//' be used for all of them.
+//' @param threads Number of threads to use (only if \code{seed} is set). Results do not 
+//' depend on the number of threads.
 //' @return A new popsnetwork object with allele frequencies set for each node.
 //'
 //' @examples
@@ -240,8 +389,11 @@ XPtr<Net_t> set_allele_freqs(const XPtr<Net_t> & p_net, const List & ini_dist);
 //'
 //' # or we can initialize and run in one call
 //' popgen_dirichlet(net, 0.3, ini_freqs)
+//'
+//' # reproducible and multithreaded
+//' popgen_dirichlet(net, 0.3, ini_freqs, seed=42, threads=2)
 // [[Rcpp::export]]
-XPtr<Net_t> popgen_dirichlet(const XPtr<Net_t> & p_net, double theta, Nullable<List> ini_dist = R_NilValue);
+XPtr<Net_t> popgen_dirichlet(const XPtr<Net_t> & p_net, double theta, Nullable<List> ini_dist = R_NilValue, Nullable<NumericVector> seed = R_NilValue, int threads = 1);
 
 
 //' @title popgen_ibm_mixed
@@ -266,6 +418,12 @@ XPtr<Net_t> popgen_dirichlet(const XPtr<Net_t> & p_net, double theta, Nullable<L
 //' a matrix of allele frequencies. Note that *any* node pre-set in this
 //' way will effectively be treated as a source and hide nodes that are further upstream (see
 //' \code{\link{set_allele_freqs}}).
+//' @param seed Seed for random number streams (optional). If set, every node draws from 
+//' its own stream, derived from \code{seed} and the node's index, instead of R's random
+//' number generator. Streams of different functions are independent, the same seed can
+//' be used for all of them.
+//' @param threads Number of threads to use (only if \code{seed} is set). Results do not 
+//' depend on the number of threads.
 //' @return A new popsnetwork object with allele frequencies set for each node.
 //'
 //' @examples
@@ -284,8 +442,50 @@ XPtr<Net_t> popgen_dirichlet(const XPtr<Net_t> & p_net, double theta, Nullable<L
 //'
 //' # or we can initialize and run in one call
 //' popgen_ibm_mixed(net, ini_freqs)
+//'
+//' # reproducible and multithreaded
+//' popgen_ibm_mixed(net, ini_freqs, seed=42, threads=2)
+// [[Rcpp::export]]
+XPtr<Net_t> popgen_ibm_mixed(const XPtr<Net_t> & p_net, Nullable<List> ini_dist = R_NilValue, Nullable<NumericVector> seed = R_NilValue, int threads = 1);
+
+
+//' @title popgen_ibm_replicates
+//' 
+//' @description Run a number of replicates of the individual-based model in parallel.
+//' 
+//' @details Runs \code{n} independent replicates of \code{\link{popgen_ibm_mixed}} on 
+//' copies of the same network. Every replicate draws from its own random number stream,
+//' which is derived from \code{seed} and the index of the replicate. Results are therefore
+//' reproducible and do not depend on the number of threads. Note that these streams are
+//' independent of R's random number generator, results differ from those of 
+//' \code{\link{popgen_ibm_mixed}} for the same state of R's generator.
+//' 
+//' @param p_net A popsnetwork object.
+//' @param n Number of replicates.
+//' @param ini_dists A list of initial distributions of allele frequencies (optional, see
+//' \code{\link{popgen_ibm_mixed}}). Replicate i is initialized with element 
+//' ((i-1) modulo length(ini_dists)) + 1.
+//' @param seed Seed for the random number streams. If NULL it is drawn from R's random number
+//' generator. Streams of different functions are independent, the same seed can
+//' be used for all of them.
+//' @param threads Number of threads to use.
+//' @param spread If TRUE, every replicate also gets a new stochastic spread of infection 
+//' (only for networks created with \code{spread_model="units"}, using the same transmission
+//' rate). Spread and genetics are then simulated in a single pass over the network.
+//' @return A list of n new popsnetwork objects with allele frequencies set for each node.
+//'
+//' @examples
+//' el <- data.frame(from=c("A", "B", "C"), to=c("C", "C", "D"), rates=c(150, 100, 200))
+//' ext <- data.frame(node=c("A", "B"), rate=c(300, 100), input=c(1000, 1000))
+//' net <- popsnetwork(el, ext, spread_model="units")
+//' freqs <- matrix(c(0.1, 0.5, 0.4, 0.9, 0.1, 0), nrow=2, ncol=3, byrow=TRUE)
+//' ini_freqs <- list(as.factor(c("A", "C")), freqs)
+//'
+//' res <- popgen_ibm_replicates(net, 10, list(ini_freqs), seed=42, threads=2)
+//' # new infection spread in each replicate
+//' res2 <- popgen_ibm_replicates(net, 10, list(ini_freqs), seed=42, spread=TRUE)
 // [[Rcpp::export]]
-XPtr<Net_t> popgen_ibm_mixed(const XPtr<Net_t> & p_net, Nullable<List> ini_dist = R_NilValue);
+List popgen_ibm_replicates(const XPtr<Net_t> & p_net, int n, Nullable<List> ini_dists = R_NilValue, Nullable<NumericVector> seed = R_NilValue, int threads = 1, bool spread = false);
 
 
 //' @title draw_isolates
@@ -0,0 +1,131 @@
+#ifndef ADJOINT_H
+#define ADJOINT_H
+
+/** @file Sensitivity analysis of the fluid model (reverse mode). */
+
+#include <vector>
+
+#include "util.h"
+
+using std::size_t;
+
+
+/** Gradient of the overall amount of infected material arriving in leaves (sum of
+ * rate_in_infd over all leaves) with respect to all link rates and source inputs of
+ * the fluid model (see preserve_mass_annotate_rates). All gradients are obtained from
+ * a single reverse sweep over the network, i.e. in O(#links) instead of one run per
+ * parameter.
+ *
+ * Link rates are taken relative to their current values. If rates are rescaled (decay
+ * in [0, 1)) changing a link rate changes the rates of the other outputs of its start
+ * node as well, this is included in the gradient.
+ *
+ * Infection within a node only starts if it receives infected material, which makes
+ * the model discontinuous where the infected input of a node is 0. This jump is
+ * ignored, i.e. clean nodes stay clean.
+ *
+ * @pre The rates have been calculated with the same parameters (see
+ * preserve_mass_annotate_rates).
+ * @param net the network.
+ * @param decay decay of material within nodes (no rescaling if outside [0, 1)).
+ * @param transm_rate rate of infection within nodes.
+ * @param d_rate gradient by link rate (indexed by link id).
+ * @param d_infd gradient by infected input of source nodes (indexed by node id, 0
+ * for nodes with inputs).
+ * @param d_in gradient by overall input of source nodes (indexed by node id, 0 for
+ * nodes with inputs). */
+template<class NET>
+void fluid_gradient(NET & net, double decay, double transm_rate,
+	std::vector<double> & d_rate, std::vector<double> & d_infd, std::vector<double> & d_in)
+	{
+	const auto & order = net.topological_order();
+	const bool rescale = decay >= 0.0 && decay < 1.0;
+
+	// adjoints of link rate (after rescaling) and infected link rate
+	std::vector<double> a_rate(net.links.size(), 0.0), a_infd(net.links.size(), 0.0);
+
+	d_rate.assign(net.links.size(), 0.0);
+	d_infd.assign(net.nodes.size(), 0.0);
+	d_in.assign(net.nodes.size(), 0.0);
+
+	for (auto i=order.rbegin(); i!=order.rend(); i++)
+		{
+		const auto * node = *i;
+
+		const double in = node->rate_in;
+		const double infd = node->rate_in_infd;
+		// infected input before transmission
+		const double infd0 = infd - node->d_rate_in_infd;
+
+		// adjoints of input rate and infected material (after transmission)
+		double a_in = 0.0;
+		double a_n_infd = node->is_leaf() ? 1.0 : 0.0;
+
+		// *** output: rate_infd = rate * infd / in
+		if (in > 0)
+			{
+			const double prop = infd / in;
+			double a_prop = 0.0;
+
+			for (auto l : node->outputs)
+				{
+				a_prop += a_infd[l->id] * l->rate;
+				a_rate[l->id] += a_infd[l->id] * prop;
+				}
+
+			a_n_infd += a_prop / in;
+			a_in -= a_prop * infd / (in * in);
+			}
+
+		// *** infection: infd = (1-t) * infd0 + t * in (only if infd0 > 0)
+		const double a_infd0 = (1.0 - transm_rate) * a_n_infd;
+		if (infd0 > 0)
+			a_in += transm_rate * a_n_infd;
+
+		// *** rescaling: rate = rate0 * f, f = in * (1-decay) / sum(rate0)
+		// rate0 is the current rate, so f is 1 (up to rounding)
+		if (rescale && !node->is_leaf())
+			{
+			double outp = 0.0, a_f = 0.0;
+			for (auto l : node->outputs)
+				{
+				outp += l->rate;
+				a_f += a_rate[l->id] * l->rate;
+				}
+
+			// without output the rates stay 0 (see preserve_mass_annotate_rates)
+			if (outp > 0)
+				{
+				const double f = in * (1.0 - decay) / outp;
+
+				a_in += a_f * (1.0 - decay) / outp;
+				const double a_outp = -a_f * f / outp;
+
+				for (auto l : node->outputs)
+					d_rate[l->id] = a_rate[l->id] * f + a_outp;
+				}
+			else
+				for (auto l : node->outputs)
+					d_rate[l->id] = 0.0;
+			}
+		else
+			for (auto l : node->outputs)
+				d_rate[l->id] = a_rate[l->id];
+
+		// *** input: in = sum(rate), infd0 = sum(rate_infd), preset for roots
+		if (node->is_root())
+			{
+			d_infd[node->id] = a_infd0;
+			d_in[node->id] = a_in;
+			}
+		else
+			for (auto l : node->inputs)
+				{
+				a_rate[l->id] += a_in;
+				a_infd[l->id] = a_infd0;
+				}
+		}
+	}
+
+
+#endif	// ADJOINT_H
@@ -0,0 +1,226 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+/** @file Allocation policies for Network. */
+
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <type_traits>
+#include <cstdlib>
+#include <new>
+
+using std::size_t;
+
+
+/** Default allocation policy, objects are created and destroyed with new/delete. */
+struct HeapAlloc
+	{
+	//! Every object has to be destroyed individually.
+	static const bool bulk = false;
+
+	template<class T, class ... ARGS>
+	T * create(ARGS && ... args)
+		{
+		return new T(std::forward<ARGS>(args)...);
+		}
+
+	template<class T>
+	void destroy(T * obj)
+		{
+		delete obj;
+		}
+
+	/** Nothing to do here. */
+	void reserve(size_t)
+		{}
+
+	void swap(HeapAlloc &)
+		{}
+	};
+
+
+/** Arena allocation policy. Objects are placed consecutively in large blocks of memory
+ * that are only released as a whole when the arena is destroyed. Creating an object
+ * therefore is little more than a pointer increment and tearing down the arena costs one
+ * free per block. Destructors are only called for types that are not trivially
+ * destructible. */
+class ArenaAlloc
+	{
+public:
+	//! Memory is released as a whole, objects without destructor need no visit.
+	static const bool bulk = true;
+
+	explicit ArenaAlloc(size_t block_size = 1 << 20)
+		: _block_size(block_size), _cur(0), _left(0)
+		{}
+
+	ArenaAlloc(const ArenaAlloc &) = delete;
+	ArenaAlloc & operator=(const ArenaAlloc &) = delete;
+
+	~ArenaAlloc()
+		{
+		for (char * b : _blocks)
+			std::free(b);
+		}
+
+	template<class T, class ... ARGS>
+	T * create(ARGS && ... args)
+		{
+		return new (allocate(sizeof(T), alignof(T))) T(std::forward<ARGS>(args)...);
+		}
+
+	template<class T>
+	void destroy(T * obj)
+		{
+		// memory is released with the arena
+		if (!std::is_trivially_destructible<T>::value)
+			obj->~T();
+		}
+
+	/** Make sure the next block will be at least @a bytes large. Useful to get all
+	 * objects into one allocation if the size of a network is known in advance. */
+	void reserve(size_t bytes)
+		{
+		if (bytes > _left)
+			new_block(bytes);
+		}
+
+	/** Uninitialized memory for @a n objects of type T. */
+	template<class T>
+	T * allocate_array(size_t n)
+		{
+		return static_cast<T *>(allocate(n * sizeof(T), alignof(T)));
+		}
+
+	void swap(ArenaAlloc & other)
+		{
+		std::swap(_block_size, other._block_size);
+		std::swap(_cur, other._cur);
+		std::swap(_left, other._left);
+		_blocks.swap(other._blocks);
+		}
+
+protected:
+	void * allocate(size_t size, size_t align)
+		{
+		size_t pad = (align - reinterpret_cast<size_t>(_cur) % align) % align;
+
+		if (size + pad > _left)
+			{
+			new_block(size + align);
+			pad = (align - reinterpret_cast<size_t>(_cur) % align) % align;
+			}
+
+		char * p = _cur + pad;
+		_cur += size + pad;
+		_left -= size + pad;
+
+		return p;
+		}
+
+	void new_block(size_t min_size)
+		{
+		const size_t size = std::max(min_size, _block_size);
+
+		char * b = static_cast<char *>(std::malloc(size));
+		if (!b)
+			throw std::bad_alloc();
+
+		_blocks.push_back(b);
+		_cur = b;
+		_left = size;
+		}
+
+	size_t _block_size;
+	char * _cur;
+	size_t _left;
+	std::vector<char *> _blocks;
+	};
+
+
+/** Growable array that takes its memory from an ArenaAlloc. Can be used as container type 
+ * for Node (see genericgraph.h) to avoid individual allocations for adjacency lists. When
+ * the array grows the old memory is simply abandoned. Only for trivially copyable types.
+ */
+template<class T>
+struct ArenaSeq
+	{
+	typedef T value_type;
+	typedef T * iterator;
+	typedef const T * const_iterator;
+
+	ArenaSeq()
+		: _data(0), _size(0), _cap(0)
+		{}
+
+	T * begin() 			{return _data;}
+	T * end() 				{return _data + _size;}
+	const T * begin() const	{return _data;}
+	const T * end() const	{return _data + _size;}
+
+	size_t size() const		{return _size;}
+	bool empty() const		{return _size == 0;}
+
+	T & operator[](size_t i)				{return _data[i];}
+	const T & operator[](size_t i) const	{return _data[i];}
+	T & back()				{return _data[_size-1];}
+	const T & back() const	{return _data[_size-1];}
+
+	void push_back(const T & t, ArenaAlloc & arena)
+		{
+		if (_size == _cap)
+			reallocate(_cap ? 2*_cap : 2, arena);
+
+		_data[_size++] = t;
+		}
+
+	/** Move content into memory owned by @a arena (e.g. after a copy). */
+	void relocate(ArenaAlloc & arena)
+		{
+		if (_cap)
+			reallocate(_size, arena);
+		}
+
+protected:
+	void reallocate(size_t cap, ArenaAlloc & arena)
+		{
+		T * d = arena.template allocate_array<T>(cap);
+		std::copy(_data, _data + _size, d);
+		_data = d;
+		_cap = cap;
+		}
+
+	T * _data;
+	size_t _size, _cap;
+	};
+
+
+/** Append to a container, using the allocation policy if required. */
+template<class CONT, class ALLOC>
+void seq_push_back(CONT & c, const typename CONT::value_type & v, ALLOC &)
+	{
+	c.push_back(v);
+	}
+
+template<class T>
+void seq_push_back(ArenaSeq<T> & c, const T & v, ArenaAlloc & arena)
+	{
+	c.push_back(v, arena);
+	}
+
+/** Give a (shallow) copy of a container its own memory. */
+template<class CONT, class ALLOC>
+void seq_relocate(CONT &, ALLOC &)
+	{
+	}
+
+template<class T>
+void seq_relocate(ArenaSeq<T> & c, ArenaAlloc & arena)
+	{
+	c.relocate(arena);
+	}
+
+
+#endif	// ARENA_H
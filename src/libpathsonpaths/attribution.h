@@ -0,0 +1,174 @@
+#ifndef ATTRIBUTION_H
+#define ATTRIBUTION_H
+
+/** @file Attribution of infected material to sources (fluid model). */
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+
+#include "util.h"
+
+using std::size_t;
+
+
+/** Contribution of each source (root node) to the infected material in each node. In the
+ * fluid model infected material is passed on in proportion to transfer rates, so a
+ * node's infected input is a linear combination of the infected material in its input
+ * nodes. Material that becomes infected within a node (see annotate_rates) does not
+ * come from any source, it is tracked as a separate pseudo-source ("transmission",
+ * index n_sources()). Contributions of a node therefore add up to its rate_in_infd.
+ *
+ * Most nodes are only reached by a few sources, contributions are therefore stored
+ * sparsely: for every node a slice of (source, value) pairs, sorted by source.
+ */
+class SourceAttribution
+	{
+public:
+	/** Prepare for a network. All root nodes are sources (numbered by increasing id).
+	 * @param nodes all nodes of a network, stored at the position of their id. */
+	template<class NODE>
+	void init(const std::vector<NODE *> & nodes)
+		{
+		_source_idx.assign(nodes.size(), std::numeric_limits<size_t>::max());
+		_sources.clear();
+
+		for (NODE * n : nodes)
+			if (n->is_root())
+				{
+				_source_idx[n->id] = _sources.size();
+				_sources.push_back(n->id);
+				}
+
+		_begin.assign(nodes.size(), 0);
+		_end.assign(nodes.size(), 0);
+		_src.clear();
+		_val.clear();
+
+		_acc.assign(_sources.size()+1, 0.0);
+		_used.assign(_sources.size()+1, false);
+		_touched.clear();
+		}
+
+	/** Calculate contributions for node @a node.
+	 * @pre annotate_rates has been run on @a node and add on all of its inputs. */
+	template<class NODE>
+	void add(const NODE * node)
+		{
+		const size_t id = node->id;
+
+		if (node->is_root())
+			{
+			// preset input
+			accumulate(_source_idx[id], node->rate_in_infd - node->d_rate_in_infd);
+			}
+		else
+			for (auto l : node->inputs)
+				{
+				const auto * from = l->from;
+				if (from->rate_in_infd <= 0 || l->rate_infd <= 0)
+					continue;
+
+				// the link carries the same proportion of each contribution
+				const double share = l->rate_infd / from->rate_in_infd;
+				for (size_t i=_begin[from->id]; i<_end[from->id]; i++)
+					accumulate(_src[i], _val[i] * share);
+				}
+
+		accumulate(_sources.size(), node->d_rate_in_infd);
+
+		std::sort(_touched.begin(), _touched.end());
+
+		_begin[id] = _src.size();
+		for (size_t s : _touched)
+			{
+			if (_acc[s] > 0)
+				{
+				_src.push_back(s);
+				_val.push_back(_acc[s]);
+				}
+			_acc[s] = 0.0;
+			_used[s] = false;
+			}
+		_end[id] = _src.size();
+
+		_touched.clear();
+		}
+
+	/** Calculate contributions for a range of nodes.
+	 * @pre The range is sorted topologically and contains all ancestors of its nodes
+	 * (see Network::topological_order), annotate_rates has been run on all of them. */
+	template<class ITER>
+	void add(const ITER & beg, const ITER & end)
+		{
+		for (ITER i=beg; i!=end; i++)
+			add(*i);
+		}
+
+	/** Number of sources (not counting transmission). */
+	size_t n_sources() const
+		{
+		return _sources.size();
+		}
+
+	/** Node id of source @a s. */
+	size_t source(size_t s) const
+		{
+		return _sources[s];
+		}
+
+	/** Number of sources contributing to node @a n. */
+	size_t size(size_t n) const
+		{
+		return _end[n] - _begin[n];
+		}
+
+	/** Index of the @a i-th source contributing to node @a n (n_sources() for
+	 * transmission). */
+	size_t source(size_t n, size_t i) const
+		{
+		return _src[_begin[n] + i];
+		}
+
+	/** Contribution of the @a i-th source contributing to node @a n. */
+	double value(size_t n, size_t i) const
+		{
+		return _val[_begin[n] + i];
+		}
+
+	/** Overall number of stored contributions. */
+	size_t n_entries() const
+		{
+		return _src.size();
+		}
+
+protected:
+	void accumulate(size_t s, double v)
+		{
+		if (v <= 0)
+			return;
+
+		if (!_used[s])
+			{
+			_used[s] = true;
+			_touched.push_back(s);
+			}
+		_acc[s] += v;
+		}
+
+	std::vector<size_t> _source_idx;	//!< source index by node id (max if none)
+	std::vector<size_t> _sources;		//!< node id by source index
+
+	std::vector<size_t> _begin;			//!< per node start of its contributions
+	std::vector<size_t> _end;			//!< per node end of its contributions
+	std::vector<size_t> _src;			//!< source index per contribution
+	std::vector<double> _val;			//!< value per contribution
+
+	// sparse accumulator, only touched entries are visited
+	std::vector<double> _acc;
+	std::vector<bool> _used;
+	std::vector<size_t> _touched;
+	};
+
+
+#endif	// ATTRIBUTION_H
@@ -0,0 +1,1241 @@
+/** @file Simple benchmarks for libpathsonpaths. Run without arguments for a list of
+ * available benchmarks. */
+
+#include <vector>
+#include <iostream>
+#include <string>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <sstream>
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+#include "genericgraph.h"
+#include "transportgraph.h"
+#include "genefreqgraph.h"
+#include "transportnetwork.h"
+#include "csrnetwork.h"
+#include "transportsoa.h"
+#include "threadpool.h"
+#include "dagexec.h"
+#include "ibmmixed.h"
+#include "replicates.h"
+#include "samplers.h"
+#include "network_io.h"
+
+
+using namespace std;
+
+template<class T>
+using StdVector = vector<T>;
+
+
+template<class GRAPH, template<class> class CONT>
+struct BenchNode :
+	public FreqNode<vector<double>>,
+	public TranspNode<>,
+	public Node<GRAPH, CONT>
+	{};
+
+template<class GRAPH>
+struct PtrNode : public BenchNode<GRAPH, StdVector> {};
+
+template<class GRAPH>
+struct CSRNode : public BenchNode<GRAPH, CSRRange> {};
+
+// no allele frequencies, so that arena nodes are trivially destructible (the heap version
+// has the same content for comparison)
+template<class GRAPH>
+struct HeapNode : public TranspNode<>, public Node<GRAPH, StdVector> {};
+
+template<class GRAPH>
+struct ArenaNode : public TranspNode<>, public Node<GRAPH, ArenaSeq> {};
+
+template<class GRAPH>
+struct BenchLink : public TranspLink<>, public Link<GRAPH>
+	{
+	BenchLink(typename GRAPH::node_t * f, typename GRAPH::node_t * t,
+		double a_rate = 0.0, double a_rate_infd = 0.0)
+		: TranspLink<>(a_rate, a_rate_infd), Link<GRAPH>(f, t)
+		{}
+	};
+
+
+typedef Graph<PtrNode, BenchLink> PtrG_t;
+typedef TransportNetwork<PtrG_t::node_t, PtrG_t::link_t> PtrNet_t;
+
+typedef Graph<CSRNode, BenchLink> CSRG_t;
+typedef TransportNetwork<CSRG_t::node_t, CSRG_t::link_t, 
+	CSRNetwork<CSRG_t::node_t, CSRG_t::link_t> > CSRNet_t;
+
+// single precision rates and frequencies
+template<class GRAPH>
+struct CSRNodeF :
+	public FreqNode<vector<float>>,
+	public TranspNode<float>,
+	public Node<GRAPH, CSRRange>
+	{};
+
+template<class GRAPH>
+struct BenchLinkF : public TranspLink<float>, public Link<GRAPH>
+	{
+	BenchLinkF(typename GRAPH::node_t * f, typename GRAPH::node_t * t,
+		double a_rate = 0.0, double a_rate_infd = 0.0)
+		: TranspLink<float>(a_rate, a_rate_infd), Link<GRAPH>(f, t)
+		{}
+	};
+
+typedef Graph<CSRNodeF, BenchLinkF> CSRGF_t;
+typedef TransportNetwork<CSRGF_t::node_t, CSRGF_t::link_t, 
+	CSRNetwork<CSRGF_t::node_t, CSRGF_t::link_t> > CSRNetF_t;
+
+// only alleles that are present are stored
+template<class GRAPH>
+struct CSRNodeS :
+	public FreqNode<SparseFreqs<double>>,
+	public TranspNode<>,
+	public Node<GRAPH, CSRRange>
+	{};
+
+typedef Graph<CSRNodeS, BenchLink> CSRGS_t;
+typedef TransportNetwork<CSRGS_t::node_t, CSRGS_t::link_t, 
+	CSRNetwork<CSRGS_t::node_t, CSRGS_t::link_t> > CSRNetS_t;
+
+typedef Graph<HeapNode, BenchLink> HeapG_t;
+typedef TransportNetwork<HeapG_t::node_t, HeapG_t::link_t> HeapNet_t;
+
+typedef Graph<ArenaNode, BenchLink> ArenaG_t;
+typedef TransportNetwork<ArenaG_t::node_t, ArenaG_t::link_t, 
+	Network<ArenaG_t::node_t, ArenaG_t::link_t, ArenaAlloc> > ArenaNet_t;
+
+static_assert(is_trivially_destructible<ArenaG_t::node_t>::value && 
+	is_trivially_destructible<ArenaG_t::link_t>::value, 
+	"arena networks are supposed to be released without visiting nodes and links");
+
+
+/** A simple edge list. */
+struct Edges
+	{
+	vector<size_t> from, to;
+	vector<double> rate;
+
+	size_t size() const
+		{
+		return from.size();
+		}
+	};
+
+/** Random DAG with n_nodes nodes and on average (max_inp+1)/2 inputs per node. */
+Edges random_dag(size_t n_nodes, size_t max_inp, mt19937 & rng)
+	{
+	Edges el;
+
+	for (size_t i=1; i<n_nodes; i++)
+		{
+		const size_t n_inp = 1 + rng() % max_inp;
+		for (size_t j=0; j<n_inp; j++)
+			{
+			el.from.push_back(rng() % i);
+			el.to.push_back(i);
+			el.rate.push_back(1.0 + rng() % 100);
+			}
+		}
+
+	return el;
+	}
+
+template<class NET>
+void build_net(NET & net, const Edges & el)
+	{
+	for (size_t i=0; i<el.size(); i++)
+		net.add_link(el.from[i], el.to[i], el.rate[i]);
+	}
+
+/** Preset input for all root nodes. */
+template<class NET>
+void set_sources(NET & net)
+	{
+	for (auto n : net.nodes)
+		if (n->is_root())
+			net.set_source(n->id, 0.5, 100);
+	}
+
+/** Full fluid model run (mass preservation and spread). */
+template<class NET>
+void run_fluid(NET & net)
+	{
+	const auto & order = net.topological_order();
+	preserve_mass(order.begin(), order.end(), 0.1);
+	annotate_rates(order.begin(), order.end(), 0.05);
+	}
+
+/** Average run time of func in seconds. */
+double time_it(const function<void()> & func, int reps)
+	{
+	const auto start = chrono::steady_clock::now();
+
+	for (int i=0; i<reps; i++)
+		func();
+
+	const chrono::duration<double> d = chrono::steady_clock::now() - start;
+
+	return d.count() / reps;
+	}
+
+
+/** Copy cost of pointer-based vs contiguous networks for increasing network sizes. */
+void bench_clone()
+	{
+	mt19937 rng(42);
+
+	cout << "edges\tNetwork(s)\tns/edge\tCSRNetwork(s)\tns/edge\n";
+
+	for (size_t n_nodes = 10000; n_nodes <= 1000000; n_nodes *= 10)
+		{
+		const Edges el = random_dag(n_nodes, 3, rng);
+
+		PtrNet_t pnet;
+		build_net(pnet, el);
+		CSRNet_t cnet;
+		build_net(cnet, el);
+		cnet.build();
+
+		const int reps = n_nodes < 1000000 ? 10 : 3;
+
+		const double tp = time_it([&pnet](){PtrNet_t copy(pnet);}, reps);
+		const double tc = time_it([&cnet](){CSRNet_t copy(cnet);}, reps);
+
+		cout << el.size() << "\t"
+			<< tp << "\t" << tp/el.size()*1e9 << "\t"
+			<< tc << "\t" << tc/el.size()*1e9 << "\n";
+		}
+	}
+
+
+/** Full fluid model run with mass preservation and spread in a single visit per node. */
+template<class NET>
+void run_fluid_fused(NET & net)
+	{
+	const auto & order = net.topological_order();
+	preserve_mass_annotate_rates(order.begin(), order.end(), 0.1, 0.05);
+	}
+
+/** Fluid model on pointer-based vs contiguous networks, two passes vs fused. */
+void bench_fluid()
+	{
+	mt19937 rng(42);
+
+	cout << "edges\tNetwork(s)\tns/edge\tCSRNetwork(s)\tns/edge\tCSR fused(s)\tns/edge\n";
+
+	for (size_t n_nodes = 10000; n_nodes <= 1000000; n_nodes *= 10)
+		{
+		const Edges el = random_dag(n_nodes, 3, rng);
+
+		PtrNet_t pnet;
+		build_net(pnet, el);
+		set_sources(pnet);
+		CSRNet_t cnet;
+		build_net(cnet, el);
+		cnet.build();
+		set_sources(cnet);
+
+		const int reps = n_nodes < 1000000 ? 10 : 3;
+
+		const double tp = time_it([&pnet](){run_fluid(pnet);}, reps);
+		const double tc = time_it([&cnet](){run_fluid(cnet);}, reps);
+		const double tf = time_it([&cnet](){run_fluid_fused(cnet);}, reps);
+
+		cout << el.size() << "\t"
+			<< tp << "\t" << tp/el.size()*1e9 << "\t"
+			<< tc << "\t" << tc/el.size()*1e9 << "\t"
+			<< tf << "\t" << tf/el.size()*1e9 << "\n";
+		}
+	}
+
+
+/** Fluid model on node objects vs structure-of-arrays rates (both contiguous). Both 
+ * versions do the same calculations, results have to be identical. */
+void bench_soa()
+	{
+	mt19937 rng(42);
+
+	cout << "edges\tAoS(s)\tns/edge\tSoA(s)\tns/edge\tSoA+copy(s)\tns/edge\tidentical\n";
+
+	for (size_t n_nodes = 10000; n_nodes <= 1000000; n_nodes *= 10)
+		{
+		const Edges el = random_dag(n_nodes, 3, rng);
+
+		CSRNet_t net;
+		build_net(net, el);
+		net.build();
+		set_sources(net);
+		net.topological_order();
+
+		TranspSoA<> soa;
+		const CSRTopology & topo = net.topology();
+
+		const int reps = n_nodes < 1000000 ? 10 : 3;
+
+		// rates are rescaled in place, so every run starts from a copy
+		CSRNet_t aos(net);
+		const double ta = time_it([&](){aos = CSRNet_t(net); run_fluid(aos);}, reps);
+		const double ts = time_it([&]()
+			{
+			soa.load(net);
+			preserve_mass(topo, soa, 0.1);
+			annotate_rates(topo, soa, 0.05);
+			}, reps);
+		CSRNet_t res(net);
+		const double tc = time_it([&]()
+			{
+			res = CSRNet_t(net);
+			soa.load(res);
+			preserve_mass(topo, soa, 0.1);
+			annotate_rates(topo, soa, 0.05);
+			soa.store(res);
+			}, reps);
+
+		bool same = true;
+		for (size_t i=0; i<net.nodes.size(); i++)
+			same = same && aos.nodes[i]->rate_in == res.nodes[i]->rate_in &&
+				aos.nodes[i]->rate_in_infd == res.nodes[i]->rate_in_infd &&
+				aos.nodes[i]->rate_out_infd == res.nodes[i]->rate_out_infd;
+		for (size_t i=0; i<net.links.size(); i++)
+			same = same && aos.links[i]->rate_infd == res.links[i]->rate_infd;
+
+		cout << el.size() << "\t"
+			<< ta << "\t" << ta/el.size()*1e9 << "\t"
+			<< ts << "\t" << ts/el.size()*1e9 << "\t"
+			<< tc << "\t" << tc/el.size()*1e9 << "\t"
+			<< (same ? "yes" : "no") << "\n";
+		}
+	}
+
+
+/** Sweep over transmission rates, one fluid run per value vs a single batched run. */
+void bench_batch()
+	{
+	mt19937 rng(42);
+
+	const Edges el = random_dag(100000, 3, rng);
+
+	CSRNet_t net;
+	build_net(net, el);
+	net.build();
+	set_sources(net);
+	net.topological_order();
+
+	cout << el.size() << " edges\n";
+	cout << "values\tsingle(s)\tbatch(s)\tspeedup\n";
+
+	for (size_t n_values = 8; n_values <= 512; n_values *= 4)
+		{
+		vector<double> transm(n_values);
+		for (size_t k=0; k<n_values; k++)
+			transm[k] = double(k) / n_values;
+
+		const double ts = time_it([&]()
+			{
+			for (double t : transm)
+				{
+				CSRNet_t copy(net);
+				const auto & order = copy.topological_order();
+				preserve_mass(order.begin(), order.end(), 0.1);
+				annotate_rates(order.begin(), order.end(), t);
+				}
+			}, 1);
+
+		const double tb = time_it([&]()
+			{
+			CSRNet_t copy(net);
+			const auto & order = copy.topological_order();
+			preserve_mass(order.begin(), order.end(), 0.1);
+			TranspBatch<> batch;
+			batch.load(copy, n_values, true);
+			annotate_rates(copy.topology(), batch, transm);
+			}, 1);
+
+		cout << n_values << "\t" << ts << "\t" << tb << "\t" << ts/tb << "\n";
+		}
+	}
+
+
+/** Double vs single precision rates: fluid model on nodes and batched runs (64 
+ * transmission rates). Accuracy is the largest relative difference in the proportion of
+ * infected material (nodes with at least 1e-6 infected). */
+void bench_precision()
+	{
+	mt19937 rng(42);
+
+	cout << "edges\tnode double(s)\tnode float(s)\tmax rel err\t"
+		"batch double(s)\tbatch float(s)\tmax rel err\n";
+
+	auto rel_err = [](double ref, double v)
+		{
+		return ref < 1e-6 ? 0.0 : std::abs(v - ref) / ref;
+		};
+
+	for (size_t n_nodes = 10000; n_nodes <= 1000000; n_nodes *= 10)
+		{
+		const Edges el = random_dag(n_nodes, 3, rng);
+
+		CSRNet_t dnet;
+		build_net(dnet, el);
+		dnet.build();
+		set_sources(dnet);
+		CSRNetF_t fnet;
+		build_net(fnet, el);
+		fnet.build();
+		set_sources(fnet);
+
+		const int reps = n_nodes < 1000000 ? 10 : 3;
+
+		// node kernels, rates are rescaled in place, so every run starts from a copy
+		CSRNet_t dres(dnet);
+		CSRNetF_t fres(fnet);
+		const double tnd = time_it([&](){dres = CSRNet_t(dnet); run_fluid_fused(dres);}, 
+			reps);
+		const double tnf = time_it([&](){fres = CSRNetF_t(fnet); run_fluid_fused(fres);}, 
+			reps);
+
+		double err_n = 0.0;
+		for (size_t i=0; i<dres.nodes.size(); i++)
+			err_n = max(err_n, rel_err(dres.nodes[i]->prop_infected(), 
+				fres.nodes[i]->prop_infected()));
+
+		// batches, rates are rescaled once
+		const size_t width = 64;
+		vector<double> transm(width);
+		for (size_t k=0; k<width; k++)
+			transm[k] = 0.5 * k / width;
+
+		TranspBatch<double> dbatch;
+		TranspBatch<float> fbatch;
+		const double tbd = time_it([&]()
+			{
+			dbatch.load(dres, width, true);
+			annotate_rates(dres.topology(), dbatch, transm);
+			}, reps);
+		const double tbf = time_it([&]()
+			{
+			fbatch.load(fres, width, true);
+			annotate_rates(fres.topology(), fbatch, transm);
+			}, reps);
+
+		double err_b = 0.0;
+		for (size_t i=0; i<dres.nodes.size(); i++)
+			for (size_t k=0; k<width; k++)
+				err_b = max(err_b, rel_err(dbatch.prop_infected(i, k), 
+					fbatch.prop_infected(i, k)));
+
+		cout << el.size() << "\t" << tnd << "\t" << tnf << "\t" << err_n << "\t"
+			<< tbd << "\t" << tbf << "\t" << err_b << "\n";
+		}
+	}
+
+
+/** Streamed fluid model vs reading the network into memory and running it there. Both
+ * read from and write to memory, so this only measures the difference in computation and
+ * memory use. */
+void bench_stream()
+	{
+	mt19937 rng(42);
+
+	cout << "edges\tin memory(s)\tstreamed(s)\tnodes\tmax live\n";
+
+	for (size_t n_nodes = 10000; n_nodes <= 1000000; n_nodes *= 10)
+		{
+		const Edges el = random_dag(n_nodes, 3, rng);
+
+		// sort by start node, node ids are a topological order already
+		vector<size_t> idx(el.size());
+		for (size_t i=0; i<idx.size(); i++)
+			idx[i] = i;
+		stable_sort(idx.begin(), idx.end(), 
+			[&el](size_t a, size_t b){return el.from[a] < el.from[b];});
+
+		ostringstream file;
+		for (size_t i : idx)
+			file << "N\t" << el.from[i] << "\t" << el.to[i] << "\t" << el.rate[i] << "\n";
+		const string links = file.str();
+		const string with_source = "S\t0\t0\t0.5\n" + links;
+
+		const double tm = time_it([&]()
+			{
+			istringstream in(links);
+			CSRNet_t net;
+			read_network(in, net);
+			net.build();
+			net.set_source(0, 0.5);
+			const auto & order = net.topological_order();
+			preserve_mass_annotate_rates(order.begin(), order.end(), 0.1, 0.05);
+
+			// same output as stream_fluid
+			ostringstream out;
+			out.precision(numeric_limits<double>::max_digits10);
+			for (auto n : net.nodes)
+				out << n->id << "\t" << n->rate_in << "\t" << n->rate_in_infd << "\t" 
+					<< n->d_rate_in_infd << "\t" << n->rate_out_infd << "\n";
+			}, 1);
+
+		StreamStats stats;
+		const double ts = time_it([&]()
+			{
+			istringstream in(with_source);
+			ostringstream out;
+			stats = stream_fluid(in, out, 0.05, 0.1);
+			}, 1);
+
+		cout << el.size() << "\t" << tm << "\t" << ts << "\t" << stats.n_nodes << "\t" 
+			<< stats.max_live << "\n";
+		}
+	}
+
+
+/** Recalculation after changing a single link rate, full vs incremental. */
+void bench_update()
+	{
+	mt19937 rng(42);
+
+	cout << "edges\tfull(s)\tincremental(s)\tspeedup\n";
+
+	for (size_t n_nodes = 10000; n_nodes <= 1000000; n_nodes *= 10)
+		{
+		const Edges el = random_dag(n_nodes, 3, rng);
+
+		CSRNet_t net;
+		build_net(net, el);
+		net.build();
+		set_sources(net);
+		run_fluid(net);
+
+		const int reps = 10;
+
+		const double tf = time_it([&net]()
+			{
+			const auto & order = net.topological_order();
+			annotate_rates(order.begin(), order.end(), 0.05);
+			}, reps);
+
+		// links into late nodes only have a small downstream cone
+		size_t i = 0;
+		const double ti = time_it([&]()
+			{
+			CSRG_t::link_t * l = net.links[net.links.size() - 1 - (i++ * 7919) % 1000];
+			l->rate *= 1.1;
+			// infected rates of the changed link are set by its start node
+			CSRG_t::node_t * dirty = l->from;
+			if (dirty->is_root())
+				net.set_source(dirty->id, dirty->rate_in_infd - dirty->d_rate_in_infd, 
+					dirty->rate_in);
+			net.update_downstream(&dirty, &dirty + 1, 0.05);
+			}, reps);
+
+		cout << el.size() << "\t" << tf << "\t" << ti << "\t" << tf/ti << "\n";
+		}
+	}
+
+
+/** Fluid model on networks with cycles. Sweep in topological order vs solve_fluid on a
+ * DAG, then solve_fluid after adding short back links (farms trading back and forth), 
+ * and on single loops that leak very slowly. */
+void bench_cycles()
+	{
+	mt19937 rng(42);
+
+	cout << "edges\tsweep(s)\tsolve DAG(s)\tback links\tsolve cyclic(s)\tns/edge\n";
+
+	for (size_t n_nodes = 10000; n_nodes <= 1000000; n_nodes *= 10)
+		{
+		Edges el = random_dag(n_nodes, 3, rng);
+
+		CSRNet_t net;
+		build_net(net, el);
+		net.build();
+		set_sources(net);
+
+		const int reps = n_nodes < 1000000 ? 10 : 3;
+
+		const double ts = time_it([&net]()
+			{
+			const auto & order = net.topological_order();
+			preserve_mass_annotate_rates(order.begin(), order.end(), 0.1, 0.05);
+			}, reps);
+		const double td = time_it([&net](){net.solve_fluid(0.05, 0.1);}, reps);
+
+		// 1% of links go back to one of the node's inputs (but not to the source)
+		const size_t n_back = el.size() / 100;
+		for (size_t i=0; i<n_back; i++)
+			{
+			const size_t l = rng() % el.size();
+			if (el.from[l] == 0)
+				continue;
+			el.from.push_back(el.to[l]);
+			el.to.push_back(el.from[l]);
+			el.rate.push_back(1.0 + rng() % 100);
+			}
+
+		CSRNet_t cnet;
+		build_net(cnet, el);
+		cnet.build();
+		set_sources(cnet);
+
+		const double tc = time_it([&cnet](){cnet.solve_fluid(0.05, 0.1);}, reps);
+
+		cout << el.size() << "\t" << ts << "\t" << td << "\t" << n_back << "\t" 
+			<< tc << "\t" << tc/el.size()*1e9 << "\n";
+		}
+
+	// a single loop that loses very little material per round, most of it goes round 
+	// ~1/decay times
+	cout << "\nloop length\tdecay\tsolve(s)\n";
+
+	for (size_t len = 10; len <= 100000; len *= 100)
+		for (double decay : {1e-3, 1e-5})
+			{
+			CSRNet_t net;
+			net.add_link(0, 1, 1.0);
+			for (size_t i=1; i<=len; i++)
+				net.add_link(i, i%len+1, 1.0);
+			net.build();
+			net.set_source(0, 0.5, 1.0);
+
+			const double t = time_it([&net, decay](){net.solve_fluid(0.05, decay);}, 3);
+
+			cout << len << "\t" << decay << "\t" << t << "\n";
+			}
+	}
+
+
+/** Level-parallel fluid model for increasing numbers of threads on a large network. */
+void bench_parallel()
+	{
+	mt19937 rng(42);
+
+	// ~5M edges
+	const Edges el = random_dag(2500000, 3, rng);
+
+	CSRNet_t net;
+	build_net(net, el);
+	net.build();
+	set_sources(net);
+
+	// serial reference
+	CSRNet_t ref(net);
+	run_fluid(ref);
+
+	cout << el.size() << " edges, " << net.level_offsets().size()-1 << " levels\n";
+	cout << "threads\ttime(s)\tspeedup\tidentical\n";
+
+	double t1 = 0;
+	for (size_t n_threads = 1; n_threads <= 32; n_threads *= 2)
+		{
+		ThreadPool pool(n_threads);
+		CSRNet_t copy(net);
+
+		const auto & order = copy.topological_order();
+		const auto & levels = copy.level_offsets();
+
+		const double t = time_it([&]()
+			{
+			parallel_levels(order, levels, pool, 
+				[](CSRG_t::node_t * n){preserve_mass(n, 0.1);});
+			parallel_levels(order, levels, pool, 
+				[](CSRG_t::node_t * n){annotate_rates(n, 0.05);});
+			}, 1);
+
+		if (n_threads == 1)
+			t1 = t;
+
+		bool same = true;
+		for (size_t i=0; i<ref.link_data.size(); i++)
+			same = same && ref.link_data[i].rate_infd == copy.link_data[i].rate_infd;
+
+		cout << n_threads << "\t" << t << "\t" << t1/t << "\t" << same << "\n";
+		}
+	}
+
+
+/** Replicates of the units genetics model for increasing numbers of threads. */
+void bench_replicates()
+	{
+	mt19937 rng(42);
+
+	const Edges el = random_dag(20000, 3, rng);
+
+	CSRNet_t net;
+	build_net(net, el);
+	net.build();
+
+	// absolute numbers of units, 4 alleles at the sources
+	for (auto n : net.nodes)
+		if (n->is_root())
+			{
+			net.set_source(n->id, 500, 1000);
+			n->frequencies = {0.1, 0.2, 0.3, 0.4};
+			}
+
+	const auto & order = net.topological_order();
+	preserve_mass(order.begin(), order.end(), 0.1);
+	StreamRng srng(42, 0);
+	annotate_rates_ibmm(order.begin(), order.end(), 0.05, srng);
+
+	const size_t n_rep = 64;
+
+	cout << el.size() << " edges, " << n_rep << " replicates\n";
+	cout << "threads\ttime(s)\tspeedup\tidentical\n";
+
+	// allele frequencies per replicate and node of the serial run
+	vector<vector<vector<double>>> ref(n_rep);
+	double t1 = 0;
+	for (size_t n_threads = 1; n_threads <= 16; n_threads *= 2)
+		{
+		vector<CSRNet_t> reps(n_rep, net);
+		ReplicateRunner runner(n_threads, 42);
+
+		const double t = time_it([&]()
+			{
+			runner.run(n_rep, [&reps](size_t i, StreamRng & r)
+				{
+				simulate_genetics_ibmm(reps[i], r);
+				});
+			}, 1);
+
+		if (n_threads == 1)
+			{
+			t1 = t;
+			for (size_t r=0; r<n_rep; r++)
+				for (const auto & n : reps[r].node_data)
+					ref[r].push_back(n.frequencies);
+			}
+
+		bool same = true;
+		for (size_t r=0; r<n_rep; r++)
+			for (size_t i=0; i<net.node_data.size(); i++)
+				same = same && ref[r][i] == reps[r].node_data[i].frequencies;
+
+		cout << n_threads << "\t" << t << "\t" << t1/t << "\t" << same << "\n";
+		}
+	}
+
+
+/** Units genetics model for increasing numbers of alleles on a network with high 
+ * out-degree. */
+void bench_alleles()
+	{
+	mt19937 rng(42);
+
+	// ~15 inputs (and outputs) per node
+	const Edges el = random_dag(20000, 30, rng);
+
+	CSRNet_t net;
+	build_net(net, el);
+	net.build();
+
+	for (auto n : net.nodes)
+		if (n->is_root())
+			net.set_source(n->id, 5000, 10000);
+
+	const auto & order = net.topological_order();
+	preserve_mass(order.begin(), order.end(), 0.1);
+	StreamRng srng(42, 0);
+	annotate_rates_ibmm(order.begin(), order.end(), 0.05, srng);
+
+	cout << el.size() << " edges\n";
+	cout << "alleles\ttime(s)\n";
+
+	for (size_t n_all : {2, 20, 200, 2000})
+		{
+		// skewed allele frequencies, most alleles are rare
+		vector<double> freqs(n_all);
+		for (size_t i=0; i<n_all; i++)
+			freqs[i] = 1.0 / ((i + 1) * (i + 1));
+		const double sum = accumulate(freqs.begin(), freqs.end(), 0.0);
+		for (auto & f : freqs)
+			f /= sum;
+
+		const int reps = 5;
+		double t = 0;
+		for (int r=0; r<reps; r++)
+			{
+			CSRNet_t copy(net);
+			for (auto n : copy.nodes)
+				if (n->is_root())
+					n->frequencies = freqs;
+
+			StreamRng grng(42, r);
+			t += time_it([&]() {simulate_genetics_ibmm(copy, grng);}, 1);
+			}
+
+		cout << n_all << "\t" << t/reps << "\n";
+		}
+	}
+
+
+/** Units genetics model with dense vs sparse allele frequencies, each source carries a
+ * few alleles of its own. */
+void bench_sparse()
+	{
+	mt19937 rng(42);
+
+	const size_t n_nodes = 20000, n_src = 2000;
+	Edges el = random_dag(n_nodes, 10, rng);
+	// additional sources, each feeding into a few nodes
+	for (size_t i=0; i<n_src; i++)
+		for (size_t j=0; j<3; j++)
+			{
+			el.from.push_back(n_nodes + i);
+			el.to.push_back(rng() % n_nodes);
+			el.rate.push_back(1.0 + rng() % 100);
+			}
+
+	CSRNet_t net;
+	build_net(net, el);
+	net.build();
+	CSRNetS_t net_s;
+	build_net(net_s, el);
+	net_s.build();
+
+	size_t n_roots = 0;
+	for (auto n : net.nodes)
+		if (n->is_root())
+			{
+			net.set_source(n->id, 5000, 10000);
+			net_s.set_source(n->id, 5000, 10000);
+			n_roots++;
+			}
+
+	// same rates in both networks
+	const auto & order = net.topological_order();
+	preserve_mass(order.begin(), order.end(), 0.1);
+	StreamRng srng(42, 0);
+	annotate_rates_ibmm(order.begin(), order.end(), 0.05, srng);
+	const auto & order_s = net_s.topological_order();
+	preserve_mass(order_s.begin(), order_s.end(), 0.1);
+	StreamRng srng_s(42, 0);
+	annotate_rates_ibmm(order_s.begin(), order_s.end(), 0.05, srng_s);
+
+	const size_t per_root = 3;
+	const size_t n_all = n_roots * per_root;
+
+	cout << el.size() << " edges, " << n_all << " alleles\n";
+	cout << "layout\ttime(s)\tvalues\n";
+
+	const int reps = 3;
+
+	double t = 0;
+	size_t n_values = 0;
+	for (int r=0; r<reps; r++)
+		{
+		CSRNet_t copy(net);
+		size_t a = 0;
+		for (auto n : copy.nodes)
+			{
+			n->frequencies.assign(n_all, 0);
+			if (n->is_root())
+				for (size_t i=0; i<per_root; i++)
+					n->frequencies[a++] = 1.0 / per_root;
+			}
+
+		StreamRng grng(42, r);
+		t += time_it([&]() {simulate_genetics_ibmm(copy, grng);}, 1);
+		n_values = n_all * copy.nodes.size();
+		}
+	cout << "dense\t" << t/reps << "\t" << n_values << "\n";
+
+	t = 0;
+	for (int r=0; r<reps; r++)
+		{
+		CSRNetS_t copy(net_s);
+		size_t a = 0;
+		for (auto n : copy.nodes)
+			{
+			n->frequencies.assign(n_all, 0);
+			if (n->is_root())
+				for (size_t i=0; i<per_root; i++)
+					n->frequencies.set(a++, 1.0 / per_root);
+			}
+
+		StreamRng grng(42, r);
+		t += time_it([&]() {simulate_genetics_ibmm(copy, grng);}, 1);
+		n_values = 0;
+		for (auto n : copy.nodes)
+			n_values += n->frequencies.n_stored();
+		}
+	cout << "sparse\t" << t/reps << "\t" << n_values << "\n";
+	}
+
+
+/** Units model replicates with a new spread each: separate traversals for spread, 
+ * scaling, genetics and normalization vs a single fused traversal. */
+void bench_fused()
+	{
+	mt19937 rng(42);
+
+	const Edges el = random_dag(20000, 30, rng);
+
+	CSRNet_t net;
+	build_net(net, el);
+	net.build();
+
+	for (auto n : net.nodes)
+		if (n->is_root())
+			net.set_source(n->id, 5000, 10000);
+
+	const double transm = 0.05;
+	const auto & order = net.topological_order();
+	preserve_mass(order.begin(), order.end(), 0.1);
+	StreamRng srng(42, 0);
+	annotate_rates_ibmm(order.begin(), order.end(), transm, srng);
+
+	const size_t n_all = 20;
+	for (auto n : net.nodes)
+		{
+		n->frequencies.assign(n_all, 0);
+		if (n->is_root())
+			for (size_t i=0; i<n_all; i++)
+				n->frequencies[i] = 1.0 / n_all;
+		}
+
+	cout << el.size() << " edges, " << n_all << " alleles\n";
+	cout << "traversal\ttime(s)\tinfected\n";
+
+	const int reps = 10;
+	// mean number of infected units over all nodes, has to be about the same
+	double infd_sep = 0, infd_fused = 0;
+
+	const double t_sep = time_it([&]()
+		{
+		for (int r=0; r<reps; r++)
+			{
+			CSRNet_t copy(net);
+			StreamRng grng(43, r);
+			const auto & o = copy.topological_order();
+			// sources start from their preset input, clean nodes don't touch their
+			// values
+			for (auto n : o)
+				{
+				if (n->is_root())
+					n->rate_in_infd -= n->d_rate_in_infd;
+				n->d_rate_in_infd = 0;
+				for (auto l : n->outputs)
+					l->rate_infd = 0;
+				}
+			annotate_rates_ibmm(o.begin(), o.end(), transm, grng);
+			simulate_genetics_ibmm(copy, grng);
+
+			for (auto n : copy.nodes)
+				infd_sep += n->rate_in_infd;
+			}
+		}, 1);
+
+	const double t_fused = time_it([&]()
+		{
+		for (int r=0; r<reps; r++)
+			{
+			CSRNet_t copy(net);
+			StreamRng grng(43, r);
+			simulate_ibmm(copy, transm, grng);
+
+			for (auto n : copy.nodes)
+				infd_fused += n->rate_in_infd;
+			}
+		}, 1);
+
+	const double norm = reps * net.nodes.size();
+	cout << "separate\t" << t_sep/reps << "\t" << infd_sep/norm << "\n";
+	cout << "fused\t" << t_fused/reps << "\t" << infd_fused/norm << "\n";
+	}
+
+
+/** Throughput of binomial and hypergeometric samplers vs standard library and plain
+ * inversion for increasing means. */
+void bench_samplers()
+	{
+	const int n_draws = 2000000;
+	Xoshiro256 eng(42);
+
+	// keeps the compiler from dropping draws
+	long sum = 0;
+
+	cout << "binomial (ns/draw)\nn\tp\tsamplers\tstd\tinversion\n";
+	for (int n : {10, 100, 1000, 10000, 1000000})
+		{
+		const double p = 0.3;
+		const double tn = time_it([&]()
+			{
+			for (int i=0; i<n_draws; i++)
+				sum += binomial(eng, n, p);
+			}, 1);
+		const double ts = time_it([&]()
+			{
+			for (int i=0; i<n_draws; i++)
+				sum += binomial_distribution<int>(n, p)(eng);
+			}, 1);
+		// inversion gets too slow for large means
+		const double ti = n > 1000 ? NAN : time_it([&]()
+			{
+			for (int i=0; i<n_draws; i++)
+				sum += binomial_binv(eng, n, p);
+			}, 1);
+
+		cout << n << "\t" << p << "\t" << tn/n_draws*1e9 << "\t" << ts/n_draws*1e9 << 
+			"\t" << ti/n_draws*1e9 << "\n";
+		}
+
+	cout << "hypergeometric (ns/draw)\nn1\tn2\tk\tsamplers\tinversion\n";
+	for (int n : {10, 100, 1000, 10000, 1000000})
+		{
+		const int n1 = n, n2 = 2*n, k = n;
+		const double tn = time_it([&]()
+			{
+			for (int i=0; i<n_draws; i++)
+				sum += hypergeometric(eng, n1, n2, k);
+			}, 1);
+		const double ti = n > 1000 ? NAN : time_it([&]()
+			{
+			for (int i=0; i<n_draws; i++)
+				sum += hypergeometric_hin(eng, n1, n2, k);
+			}, 1);
+
+		cout << n1 << "\t" << n2 << "\t" << k << "\t" << tn/n_draws*1e9 << "\t" << 
+			ti/n_draws*1e9 << "\n";
+		}
+
+	cerr << sum << "\n";
+	}
+
+
+/** Random DAG plus a long chain hanging off its first node. Processing by levels has 
+ * to synchronize once per link of the chain. */
+Edges skewed_dag(size_t n_nodes, size_t chain, mt19937 & rng)
+	{
+	Edges el = random_dag(n_nodes, 3, rng);
+
+	size_t last = 0;
+	for (size_t i=0; i<chain; i++)
+		{
+		el.from.push_back(last);
+		el.to.push_back(n_nodes + i);
+		el.rate.push_back(1.0);
+		last = n_nodes + i;
+		}
+
+	return el;
+	}
+
+/** Level-parallel vs dependency-driven fluid model on a network with a long chain. */
+void bench_dag()
+	{
+	mt19937 rng(42);
+
+	const Edges el = skewed_dag(1000000, 10000, rng);
+
+	CSRNet_t net;
+	build_net(net, el);
+	net.build();
+	set_sources(net);
+
+	CSRNet_t ref(net);
+	run_fluid(ref);
+
+	cout << el.size() << " edges, " << net.level_offsets().size()-1 << " levels\n";
+	cout << "threads\tlevels(s)\tDAG(s)\tidentical\n";
+
+	for (size_t n_threads = 1; n_threads <= 32; n_threads *= 2)
+		{
+		ThreadPool pool(n_threads);
+		DAGExecutor exec(n_threads);
+		CSRNet_t lcopy(net), dcopy(net);
+
+		const auto & order = lcopy.topological_order();
+		const auto & levels = lcopy.level_offsets();
+
+		const double tl = time_it([&]()
+			{
+			parallel_levels(order, levels, pool, 
+				[](CSRG_t::node_t * n){preserve_mass(n, 0.1);});
+			parallel_levels(order, levels, pool, 
+				[](CSRG_t::node_t * n){annotate_rates(n, 0.05);});
+			}, 1);
+
+		const double td = time_it([&]()
+			{
+			exec.run(dcopy.nodes, [](CSRG_t::node_t * n){preserve_mass(n, 0.1);});
+			exec.run(dcopy.nodes, [](CSRG_t::node_t * n){annotate_rates(n, 0.05);});
+			}, 1);
+
+		bool same = true;
+		for (size_t i=0; i<ref.link_data.size(); i++)
+			same = same && ref.link_data[i].rate_infd == dcopy.link_data[i].rate_infd;
+
+		cout << n_threads << "\t" << tl << "\t" << td << "\t" << same << "\n";
+		}
+	}
+
+
+/** Layered diamond graph, two nodes per layer, each connected to both nodes of the next
+ * layer. The number of paths grows exponentially with depth. */
+Edges diamond(size_t n_layers)
+	{
+	Edges el;
+
+	for (size_t i=0; i+1<n_layers; i++)
+		for (size_t f=2*i; f<2*i+2; f++)
+			for (size_t t=2*i+2; t<2*i+4; t++)
+				{
+				el.from.push_back(f);
+				el.to.push_back(t);
+				el.rate.push_back(1.0);
+				}
+
+	return el;
+	}
+
+/** Resetting visitation marks downstream/upstream on layered diamond graphs. Time per 
+ * node has to stay constant with increasing depth. */
+void bench_reset()
+	{
+	cout << "nodes\tdownstream(s)\tns/node\tupstream(s)\tns/node\n";
+
+	for (size_t n_layers = 1000; n_layers <= 1000000; n_layers *= 10)
+		{
+		PtrNet_t net;
+		build_net(net, diamond(n_layers));
+
+		const size_t n_nodes = net.nodes.size();
+		const int reps = n_layers < 1000000 ? 10 : 3;
+
+		PtrG_t::node_t & first = *net.nodes.front();
+		PtrG_t::node_t & last = *net.nodes.back();
+		VisitMarks marks(n_nodes), reached(n_nodes);
+
+		const double td = time_it([&](){reset_downstream(first, marks, reached);}, reps);
+		const double tu = time_it([&](){reset_upstream(last, marks, reached);}, reps);
+
+		cout << n_nodes << "\t"
+			<< td << "\t" << td/n_nodes*1e9 << "\t"
+			<< tu << "\t" << tu/n_nodes*1e9 << "\n";
+		}
+	}
+
+
+/** Construct and tear down a network of type NET, times for both are added to 
+ * @a t_build and @a t_free. */
+template<class NET>
+void build_free(const Edges & el, size_t reserve_nodes, double & t_build, double & t_free)
+	{
+	const auto start = chrono::steady_clock::now();
+
+	NET * net = new NET;
+	if (reserve_nodes)
+		net->reserve(reserve_nodes, el.size());
+	build_net(*net, el);
+
+	const auto built = chrono::steady_clock::now();
+
+	delete net;
+
+	const chrono::duration<double> db = built - start;
+	const chrono::duration<double> df = chrono::steady_clock::now() - built;
+	t_build += db.count();
+	t_free += df.count();
+	}
+
+/** Construction and teardown of networks with nodes and links on the heap vs in an arena. 
+ * Nodes and links are trivially destructible, so tearing down an arena network does not 
+ * visit them. */
+void bench_build()
+	{
+	mt19937 rng(42);
+
+	cout << "edges\theap(s)\tfree(s)\tarena(s)\tfree(s)\tarena+reserve(s)\tfree(s)\n";
+
+	for (size_t n_nodes = 10000; n_nodes <= 1000000; n_nodes *= 10)
+		{
+		const Edges el = random_dag(n_nodes, 3, rng);
+
+		const int reps = n_nodes < 1000000 ? 10 : 3;
+
+		double th = 0, fh = 0, ta = 0, fa = 0, tr = 0, fr = 0;
+		for (int i=0; i<reps; i++)
+			{
+			build_free<HeapNet_t>(el, 0, th, fh);
+			build_free<ArenaNet_t>(el, 0, ta, fa);
+			build_free<ArenaNet_t>(el, n_nodes, tr, fr);
+			}
+
+		cout << el.size() 
+			<< "\t" << th/reps << "\t" << fh/reps 
+			<< "\t" << ta/reps << "\t" << fa/reps 
+			<< "\t" << tr/reps << "\t" << fr/reps << "\n";
+		}
+	}
+
+
+int main(int argc, char ** argv)
+	{
+	const string which = argc > 1 ? argv[1] : "";
+
+	if (which == "clone")
+		bench_clone();
+	else if (which == "build")
+		bench_build();
+	else if (which == "fluid")
+		bench_fluid();
+	else if (which == "reset")
+		bench_reset();
+	else if (which == "soa")
+		bench_soa();
+	else if (which == "update")
+		bench_update();
+	else if (which == "batch")
+		bench_batch();
+	else if (which == "parallel")
+		bench_parallel();
+	else if (which == "dag")
+		bench_dag();
+	else if (which == "cycles")
+		bench_cycles();
+	else if (which == "precision")
+		bench_precision();
+	else if (which == "stream")
+		bench_stream();
+	else if (which == "replicates")
+		bench_replicates();
+	else if (which == "samplers")
+		bench_samplers();
+	else if (which == "alleles")
+		bench_alleles();
+	else if (which == "sparse")
+		bench_sparse();
+	else if (which == "fused")
+		bench_fused();
+	else
+		{
+		cerr << "usage: " << argv[0] << " BENCHMARK\n";
+		cerr << "available benchmarks:\n";
+		cerr << "\tclone\tcopying networks\n";
+		cerr << "\tbuild\tconstruction and teardown of networks\n";
+		cerr << "\tfluid\tfluid spread model\n";
+		cerr << "\treset\tresetting nodes on layered diamond graphs\n";
+		cerr << "\tsoa\tfluid model on node objects vs structure-of-arrays\n";
+		cerr << "\tupdate\trecalculation after changing a link, full vs incremental\n";
+		cerr << "\tbatch\tsweep over transmission rates, single vs batched runs\n";
+		cerr << "\tparallel\tlevel-parallel fluid model, 1-32 threads\n";
+		cerr << "\tdag\tlevel-parallel vs dependency-driven fluid model\n";
+		cerr << "\tcycles\tfluid model on networks with cycles\n";
+		cerr << "\tprecision\tdouble vs single precision rates\n";
+		cerr << "\tstream\tstreamed vs in-memory fluid model\n";
+		cerr << "\treplicates\tunits genetics model replicates, 1-16 threads\n";
+		cerr << "\tsamplers\tbinomial and hypergeometric samplers\n";
+		cerr << "\talleles\tunits genetics model, 2-2000 alleles\n";
+		cerr << "\tsparse\tunits genetics model, dense vs sparse allele frequencies\n";
+		cerr << "\tfused\tunits model replicates, separate vs fused traversals\n";
+		return 1;
+		}
+
+	return 0;
+	}
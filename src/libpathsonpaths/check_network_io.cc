@@ -0,0 +1,208 @@
+/** @file Checks stream_fluid against reading the network into memory and running the
+ * fluid model on it (see preserve_mass_annotate_rates), for random DAGs with several
+ * sources, with and without rescaling. Returns 1 if any test fails. */
+
+#include <vector>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "genericgraph.h"
+#include "transportgraph.h"
+#include "transportnetwork.h"
+#include "csrnetwork.h"
+#include "network_io.h"
+
+
+using namespace std;
+
+
+template<class GRAPH>
+struct CheckNode :
+	public TranspNode<>,
+	public Node<GRAPH, CSRRange>
+	{};
+
+template<class GRAPH>
+struct CheckLink : public TranspLink<>, public Link<GRAPH>
+	{
+	CheckLink(typename GRAPH::node_t * f, typename GRAPH::node_t * t,
+		double a_rate = 0.0, double a_rate_infd = 0.0)
+		: TranspLink<>(a_rate, a_rate_infd), Link<GRAPH>(f, t)
+		{}
+	};
+
+typedef Graph<CheckNode, CheckLink> CheckG_t;
+typedef TransportNetwork<CheckG_t::node_t, CheckG_t::link_t,
+	CSRNetwork<CheckG_t::node_t, CheckG_t::link_t> > CheckNet_t;
+
+
+/** A random DAG in file format, sorted by start node (node ids are a topological
+ * order). About one in ten nodes is a source. */
+struct RandomNet
+	{
+	string links;			//!< "N" records
+	string sources;			//!< "S" records
+	vector<pair<size_t, double> > src;
+	};
+
+RandomNet random_net(size_t n_nodes, mt19937 & rng)
+	{
+	vector<vector<pair<size_t, double> > > outputs(n_nodes);
+	RandomNet res;
+
+	// the last node can't be a source, so every source has a later non-source
+	vector<bool> is_source(n_nodes, false);
+	for (size_t i=0; i<n_nodes-1; i++)
+		is_source[i] = i == 0 || rng() % 10 == 0;
+
+	for (size_t i=0; i<n_nodes; i++)
+		{
+		if (is_source[i])
+			{
+			res.src.emplace_back(i, 0.01 * (1 + rng() % 100));
+			// every source has at least one output, sources have no inputs
+			size_t t = i + 1 + rng() % (n_nodes-i-1);
+			while (is_source[t])
+				t++;
+			outputs[i].emplace_back(t, 1.0 + rng() % 100);
+			continue;
+			}
+
+		const size_t n_inp = 1 + rng() % 3;
+		for (size_t j=0; j<n_inp; j++)
+			outputs[rng() % i].emplace_back(i, 1.0 + rng() % 100);
+		}
+
+	ostringstream links, sources;
+	links.precision(numeric_limits<double>::max_digits10);
+	for (size_t i=0; i<n_nodes; i++)
+		for (const auto & o : outputs[i])
+			links << "N\t" << i << "\t" << o.first << "\t" << o.second << "\n";
+	for (const auto & s : res.src)
+		sources << "S\t" << s.first << "\t" << s.first << "\t" << s.second << "\n";
+
+	res.links = links.str();
+	res.sources = sources.str();
+
+	return res;
+	}
+
+/** Node values as written by stream_fluid, indexed by node id. */
+vector<vector<double> > parse(const string & str)
+	{
+	vector<vector<double> > res;
+	istringstream in(str);
+	size_t id;
+	vector<double> v(4);
+
+	while (in >> id >> v[0] >> v[1] >> v[2] >> v[3])
+		{
+		if (res.size() <= id)
+			res.resize(id+1);
+		res[id] = v;
+		}
+
+	return res;
+	}
+
+/** Largest relative difference between stream_fluid and the in-memory fluid model. */
+double compare(const RandomNet & rn, double transm_rate, double decay)
+	{
+	istringstream in_links(rn.links);
+	CheckNet_t net;
+	read_network(in_links, net);
+	net.build();
+	for (const auto & s : rn.src)
+		net.set_source(s.first, s.second);
+	const auto & order = net.topological_order();
+	preserve_mass_annotate_rates(order.begin(), order.end(), decay, transm_rate);
+
+	istringstream in(rn.sources + rn.links);
+	ostringstream out;
+	stream_fluid(in, out, transm_rate, decay);
+	const auto streamed = parse(out.str());
+
+	if (streamed.size() != net.nodes.size())
+		return INFINITY;
+
+	double diff = 0.0;
+	for (auto n : net.nodes)
+		{
+		const auto & s = streamed[n->id];
+		if (s.empty())
+			return INFINITY;
+
+		const double mem[] = {n->rate_in, n->rate_in_infd, n->d_rate_in_infd,
+			n->rate_out_infd};
+		for (size_t i=0; i<4; i++)
+			diff = max(diff, abs(mem[i] - s[i]) / max(1.0, abs(mem[i])));
+		}
+
+	return diff;
+	}
+
+/** Whether stream_fluid rejects @a file. */
+bool rejects(const string & file)
+	{
+	istringstream in(file);
+	ostringstream out;
+
+	try {
+		stream_fluid(in, out, 0.1);
+		}
+	catch (runtime_error &)
+		{
+		return true;
+		}
+
+	return false;
+	}
+
+
+int main()
+	{
+	// output is written with full precision, only rounding while parsing remains
+	const double max_diff = 1e-14;
+
+	mt19937 rng(42);
+	int failed = 0;
+
+	for (size_t n_nodes : {2, 10, 100, 1000, 10000})
+		for (int rep=0; rep<3; rep++)
+			{
+			const RandomNet rn = random_net(n_nodes, rng);
+
+			for (double decay : {-1.0, 0.0, 0.1})
+				{
+				const double d = compare(rn, 0.05, decay);
+				const bool ok = d <= max_diff;
+				failed += !ok;
+				cout << "nodes=" << n_nodes << " decay=" << decay << "\tdiff=" << d <<
+					(ok ? "\tok\n" : "\tFAILED\n");
+				}
+			}
+
+	cout << "*** invalid input\n";
+
+	const vector<pair<string, string> > invalid = {
+		{"unsorted", "N\t0\t1\t1\nN\t1\t2\t1\nN\t0\t2\t1\n"},
+		{"link into source", "S\t1\t1\t0.5\nN\t0\t1\t1\nN\t1\t2\t1\n"},
+		{"source after its outputs", "N\t0\t1\t1\nS\t0\t0\t0.5\n"},
+		{"source with input", "N\t0\t1\t1\nS\t1\t1\t0.5\nN\t1\t2\t1\n"}};
+
+	for (const auto & inv : invalid)
+		{
+		const bool ok = rejects(inv.second);
+		failed += !ok;
+		cout << inv.first << (ok ? "\tok\n" : "\tFAILED\n");
+		}
+
+	cout << (failed ? "FAILED\n" : "all tests passed\n");
+
+	return failed ? 1 : 0;
+	}
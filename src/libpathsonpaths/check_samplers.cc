@@ -0,0 +1,208 @@
+/** @file Statistical validation of the samplers in samplers.h. Compares histograms of
+ * a large number of draws against exact probabilities (chi-square goodness of fit) for
+ * parameters that cover all code paths. Continuous variates are binned. Returns 1 if 
+ * any test fails. */
+
+#include <vector>
+#include <iostream>
+#include <functional>
+#include <cmath>
+#include <algorithm>
+
+#include "streamrng.h"
+#include "samplers.h"
+
+
+using namespace std;
+
+
+/** Outcome of a goodness of fit test. */
+struct Fit
+	{
+	double chi2;
+	size_t df;
+	//! Wilson-Hilferty approximation, ~N(0, 1) if the fit is good
+	double z;
+	};
+
+/** Compare @a n draws from @a draw against probabilities @a pmf over [lo, hi]. Cells
+ * with small expected counts are pooled with their neighbours. */
+Fit fit(const function<int()> & draw, const function<double(int)> & pmf, int lo, int hi,
+	size_t n)
+	{
+	vector<double> count(hi - lo + 1, 0.0);
+	for (size_t i=0; i<n; i++)
+		{
+		const int x = draw();
+		if (x < lo || x > hi)
+			{
+			// outside the support, fails for sure
+			return {INFINITY, 1, INFINITY};
+			}
+		count[x - lo]++;
+		}
+
+	Fit res = {0, 0, 0};
+	double obs = 0, expd = 0;
+	for (int x=lo; x<=hi; x++)
+		{
+		obs += count[x - lo];
+		expd += n * pmf(x);
+
+		if (expd >= 10 || x == hi)
+			{
+			res.chi2 += (obs - expd) * (obs - expd) / max(expd, 1e-300);
+			res.df++;
+			obs = expd = 0;
+			}
+		}
+
+	const double k = max(size_t(1), res.df - 1);
+	res.z = (pow(res.chi2 / k, 1.0/3) - (1 - 2 / (9 * k))) / sqrt(2 / (9 * k));
+
+	return res;
+	}
+
+double binom_pmf(int n, double p, int x)
+	{
+	return exp(lgamma(n + 1.0) - lgamma(x + 1.0) - lgamma(n - x + 1.0) +
+		x * log(p) + (n - x) * log1p(-p));
+	}
+
+double hyper_pmf(int n1, int n2, int k, int x)
+	{
+	auto lc = [](int a, int b) {return lgamma(a + 1.0) - lgamma(b + 1.0) - lgamma(a - b + 1.0);};
+	return exp(lc(n1, x) + lc(n2, k - x) - lc(n1 + n2, k));
+	}
+
+/** Regularized lower incomplete gamma function P(a, x), by its series for x < a+1 and
+ * by the continued fraction for Q = 1-P otherwise (Numerical Recipes 6.2). */
+double gamma_p(double a, double x)
+	{
+	if (x <= 0)
+		return 0;
+
+	const double lg = -x + a * log(x) - lgamma(a);
+
+	if (x < a + 1)
+		{
+		double sum = 1.0 / a, term = sum;
+		for (double n=a+1; fabs(term) > fabs(sum) * 1e-16; n++)
+			{
+			term *= x / n;
+			sum += term;
+			}
+		return sum * exp(lg);
+		}
+
+	// modified Lentz
+	const double tiny = 1e-300;
+	double b = x + 1 - a, c = 1 / tiny, d = 1 / b, h = d;
+	for (int i=1; i<100000; i++)
+		{
+		const double an = -i * (i - a);
+		b += 2;
+		d = an * d + b;
+		d = fabs(d) < tiny ? tiny : d;
+		c = b + an / c;
+		c = fabs(c) < tiny ? tiny : c;
+		d = 1 / d;
+		const double del = d * c;
+		h *= del;
+		if (fabs(del - 1) < 1e-16)
+			break;
+		}
+
+	return 1 - exp(lg) * h;
+	}
+
+
+int main()
+	{
+	const size_t n_draws = 1000000;
+	// very unlikely to be exceeded by chance for all tests together
+	const double z_max = 5;
+
+	Xoshiro256 eng(42);
+	int failed = 0;
+
+	auto report = [&](const char * what, const Fit & f)
+		{
+		const bool ok = f.z < z_max;
+		failed += !ok;
+		cout << what << "\tchi2=" << f.chi2 << "\tdf=" << f.df << "\tz=" << f.z <<
+			(ok ? "\tok\n" : "\tFAILED\n");
+		};
+
+	cout << "*** binomial\n";
+
+	// inversion, BTPE recursion and squeeze, p > 0.5
+	const vector<pair<int, double>> bin_par = {
+		{1, 0.5}, {10, 0.3}, {100, 0.25}, {100, 0.5}, {1000, 0.05}, {2000, 0.4},
+		{1000000, 0.3}, {1000, 0.97}, {50, 0.999}, {200000000, 0.001}};
+
+	for (const auto & par : bin_par)
+		{
+		const int n = par.first;
+		const double p = par.second;
+		const double sd = sqrt(n * p * (1 - p));
+		const int lo = max(0, int(n * p - 12 * sd - 1)), hi = min(n, int(n * p + 12 * sd + 1));
+
+		cout << "n=" << n << " p=" << p;
+		report("", fit([&]() {return binomial(eng, n, p);},
+			[&](int x) {return binom_pmf(n, p, x);}, lo, hi, n_draws));
+		}
+
+	// degenerate cases
+	failed += binomial(eng, 0, 0.5) != 0 || binomial(eng, 10, 0) != 0 ||
+		binomial(eng, 10, 1) != 10;
+
+	cout << "*** hypergeometric\n";
+
+	// inversion, H2PE explicit and squeeze, all combinations of swapped colours/draws
+	const vector<vector<int>> hyp_par = {
+		{5, 10, 7}, {50, 60, 40}, {500, 500, 300}, {2000, 8000, 3000}, {100, 100000, 5000},
+		{10000, 5, 9000}, {30, 70, 90}, {8000, 2000, 7000}, {100000, 100000, 100000},
+		{1000000, 1000000, 10}};
+
+	for (const auto & par : hyp_par)
+		{
+		const int n1 = par[0], n2 = par[1], k = par[2];
+		const int lo = max(0, k - n2), hi = min(n1, k);
+
+		cout << "n1=" << n1 << " n2=" << n2 << " k=" << k;
+		report("", fit([&]() {return hypergeometric(eng, n1, n2, k);},
+			[&](int x) {return hyper_pmf(n1, n2, k, x);}, lo, hi, n_draws));
+		}
+
+	failed += hypergeometric(eng, 10, 20, 0) != 0 || hypergeometric(eng, 10, 20, 30) != 10 ||
+		hypergeometric(eng, 0, 20, 5) != 0 || hypergeometric(eng, 10, 0, 5) != 5;
+
+	cout << "*** gamma\n";
+
+	// boosted small shapes, shape 1, Marsaglia-Tsang with small and large shapes
+	const vector<double> gam_par = {0.05, 0.3, 0.9, 1.0, 1.5, 3.7, 20, 1000};
+
+	for (double a : gam_par)
+		{
+		// 200 cells over mean +- 12 sd, the last one is open
+		const double sd = sqrt(a), lo_x = max(0.0, a - 12 * sd), w = (a + 12 * sd - lo_x) / 200;
+		const int hi = 200;
+
+		cout << "shape=" << a;
+		report("", fit([&]() 
+				{
+				const double x = gamma_variate(eng, a);
+				return x < lo_x ? -1 : min(hi, int((x - lo_x) / w));
+				},
+			[&](int i) 
+				{
+				return (i == hi ? 1.0 : gamma_p(a, lo_x + (i+1) * w)) - 
+					gamma_p(a, lo_x + i * w);
+				}, 0, hi, n_draws));
+		}
+
+	cout << (failed ? "FAILED\n" : "all tests passed\n");
+
+	return failed ? 1 : 0;
+	}
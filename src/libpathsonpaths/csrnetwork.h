@@ -0,0 +1,454 @@
+#ifndef CSRNETWORK_H
+#define CSRNETWORK_H
+
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <memory>
+
+#include "util.h"
+#include "network.h"
+
+using std::size_t;
+
+
+/** Read-only view of a slice of a CSR index array. Dereferencing yields pointers into
+ * the link array of the owning network, which makes CSRRange usable as container type
+ * of Node (see genericgraph.h) in place of a std::vector of link pointers.
+ * @tparam P link pointer type. */
+template<class P>
+struct CSRRange
+	{
+	typedef P value_type;
+	typedef typename std::remove_pointer<P>::type elem_t;
+
+	struct iterator
+		{
+		elem_t * base;
+		const size_t * i;
+
+		iterator(elem_t * b, const size_t * idx)
+			: base(b), i(idx)
+			{}
+
+		P operator*() const 			{return base + *i;}
+		iterator & operator++() 		{++i; return *this;}
+		bool operator==(const iterator & o) const {return i == o.i;}
+		bool operator!=(const iterator & o) const {return i != o.i;}
+		};
+
+	typedef iterator const_iterator;
+
+	elem_t * base;		//!< start of the link array
+	const size_t * b;	//!< first index
+	const size_t * e;	//!< one past the last index
+
+	CSRRange()
+		: base(0), b(0), e(0)
+		{}
+
+	iterator begin() const
+		{
+		return iterator(base, b);
+		}
+	iterator end() const
+		{
+		return iterator(base, e);
+		}
+
+	size_t size() const
+		{
+		return e - b;
+		}
+	bool empty() const
+		{
+		return e == b;
+		}
+
+	P operator[](size_t i) const
+		{
+		return base + b[i];
+		}
+	P back() const
+		{
+		return base + *(e-1);
+		}
+	};
+
+
+/** Topology of a CSRNetwork. All adjacency information is stored as indices so that 
+ * it can be shared between copies of a network. */
+struct CSRTopology
+	{
+	std::vector<size_t> link_from;	//!< start node index per link
+	std::vector<size_t> link_to;	//!< end node index per link
+
+	std::vector<size_t> in_offset;	//!< per node offset into in_idx (size #nodes+1)
+	std::vector<size_t> out_offset;	//!< per node offset into out_idx (size #nodes+1)
+	std::vector<size_t> in_idx;		//!< indices of input links, grouped by node
+	std::vector<size_t> out_idx;	//!< indices of output links, grouped by node
+	std::vector<size_t> in_slot;	//!< per entry in in_idx, position of the link in out_idx
+
+	std::vector<size_t> order;		//!< node indices in topological order
+	std::vector<size_t> level_offset;	//!< start of each level in order (plus end)
+
+	std::vector<size_t> comp_order;	//!< node indices grouped by component (only with cycles)
+	std::vector<size_t> comp_offset;	//!< start of each component in comp_order (plus end)
+
+	/** Calculate offsets and index arrays from the list of links. */
+	void build(size_t n_nodes)
+		{
+		const size_t n_links = link_from.size();
+
+		// count degrees
+		in_offset.assign(n_nodes+1, 0);
+		out_offset.assign(n_nodes+1, 0);
+		for (size_t i=0; i<n_links; i++)
+			{
+			in_offset[link_to[i]+1]++;
+			out_offset[link_from[i]+1]++;
+			}
+
+		// prefix sum => offsets
+		for (size_t i=0; i<n_nodes; i++)
+			{
+			in_offset[i+1] += in_offset[i];
+			out_offset[i+1] += out_offset[i];
+			}
+
+		// fill in link indices, keeps insertion order per node
+		in_idx.resize(n_links);
+		out_idx.resize(n_links);
+		std::vector<size_t> in_pos(in_offset.begin(), in_offset.end()-1);
+		std::vector<size_t> out_pos(out_offset.begin(), out_offset.end()-1);
+		for (size_t i=0; i<n_links; i++)
+			{
+			in_idx[in_pos[link_to[i]]++] = i;
+			out_idx[out_pos[link_from[i]]++] = i;
+			}
+
+		// in_pos is not needed anymore, re-use as position in out_idx by link
+		in_pos.resize(n_links);
+		for (size_t i=0; i<n_links; i++)
+			in_pos[out_idx[i]] = i;
+		in_slot.resize(n_links);
+		for (size_t i=0; i<n_links; i++)
+			in_slot[i] = in_pos[in_idx[i]];
+
+		sort_nodes(n_nodes);
+
+		// set up by CSRNetwork::build if needed
+		comp_order.clear();
+		comp_offset.clear();
+		}
+
+	/** Sort nodes topologically (Kahn's algorithm), grouped into levels (see 
+	 * topological_sort in genericgraph.h). Nodes that are part of a cycle are 
+	 * missing from the result. */
+	void sort_nodes(size_t n_nodes)
+		{
+		// number of unprocessed inputs per node
+		std::vector<size_t> n_inputs(n_nodes);
+
+		order.clear();
+		order.reserve(n_nodes);
+
+		for (size_t i=0; i<n_nodes; i++)
+			{
+			n_inputs[i] = in_offset[i+1] - in_offset[i];
+			if (n_inputs[i] == 0)
+				order.push_back(i);
+			}
+
+		level_offset.assign(1, 0);
+
+		// order doubles as queue, see topological_sort
+		for (size_t b=0; b<order.size(); )
+			{
+			const size_t e = order.size();
+			for (size_t i=b; i<e; i++)
+				{
+				const size_t n = order[i];
+				for (size_t j=out_offset[n]; j<out_offset[n+1]; j++)
+					{
+					const size_t to = link_to[out_idx[j]];
+					if (--n_inputs[to] == 0)
+						order.push_back(to);
+					}
+				}
+
+			level_offset.push_back(e);
+			b = e;
+			}
+		}
+	};
+
+
+/** Network with contiguous storage. Nodes and links are kept in two arrays, adjacency
+ * is stored in compressed sparse row format (per node an offset into a shared array of
+ * link indices). Nodes have to use CSRRange as container type.
+ *
+ * Links can be added in any order, but the adjacency information (and therefore
+ * Node::inputs, Node::outputs and all link pointers) is only valid after build() has
+ * been called. Node data, however, can be accessed (e.g. by set_source) at any time.
+ *
+ * The topology is reference counted and shared between copies of a network, a copy
+ * therefore only duplicates node and link state. Adding links to a network that shares
+ * its topology will detach it first (copy on write).
+ *
+ * For compatibility with the algorithms written for Network, CSRNetwork keeps the same
+ * public vectors of node and link pointers.
+ * @param N node type.
+ * @param L link type. */
+template<class N, class L>
+struct CSRNetwork : public AbstractNetwork
+	{
+	std::vector<N *> nodes;		//!< pointers to all nodes (into node_data)
+	std::vector<L *> links;		//!< pointers to all links (into link_data)
+
+	std::vector<N> node_data;	//!< node storage
+	std::vector<L> link_data;	//!< link storage
+
+	CSRNetwork()
+		: _topo(std::make_shared<CSRTopology>()), _built(true)
+		{}
+
+	/** Copy node and link state, share topology. */
+	CSRNetwork(const CSRNetwork & other)
+		: node_data(other.node_data), link_data(other.link_data),
+		_topo(other._topo), _built(other._built)
+		{
+		if (_built)
+			rewire();
+		else
+			update_node_ptrs();
+		}
+
+	CSRNetwork(CSRNetwork && tmp) = default;
+
+	/** Take over content of @a tmp. Swapping leaves all internal pointers valid. */
+	CSRNetwork & operator=(CSRNetwork && tmp)
+		{
+		swap(tmp.nodes, nodes);
+		swap(tmp.links, links);
+		swap(tmp.node_data, node_data);
+		swap(tmp.link_data, link_data);
+		swap(tmp._topo, _topo);
+		std::swap(tmp._built, _built);
+		swap(tmp._order, _order);
+		swap(tmp._comp_order, _comp_order);
+
+		return *this;
+		}
+
+	/** Add an edge. Source and target nodes have to be specified as indices.
+	 * @param from, to indices of nodes being linked
+	 * @param rate transfer rate of material (in amount per unit time) */
+	void add_link(size_t from, size_t to, double rate)
+		{
+		if (node_data.size() <= std::max(from, to))
+			{
+			node_data.resize(std::max(from, to)+1);
+			update_node_ptrs();
+			}
+
+		detach();
+
+		_topo->link_from.push_back(from);
+		_topo->link_to.push_back(to);
+		link_data.push_back(L(0, 0, rate));
+		link_data.back().id = link_data.size()-1;
+
+		_built = false;
+		_order.clear();
+		_comp_order.clear();
+		}
+
+	void set_source(size_t s, double p, double i) {}
+
+	/** Set up adjacency and pointers. Has to be called after the last link has been
+	 * added and before the network is used. */
+	void build()
+		{
+		if (_built)
+			return;
+
+		detach();
+		_topo->build(node_data.size());
+
+		_built = true;
+
+		rewire();
+
+		// condensation of cycles, only needed (and calculated) if there are any
+		if (!acyclic())
+			{
+			std::vector<N *> comp;
+			strong_components(nodes, comp, _topo->comp_offset);
+			_topo->comp_order.resize(comp.size());
+			for (size_t i=0; i<comp.size(); i++)
+				_topo->comp_order[i] = comp[i]->id;
+			}
+		}
+
+	/** Whether adjacency information is up to date. */
+	bool built() const
+		{
+		return _built;
+		}
+
+	/** Network topology. */
+	const CSRTopology & topology() const
+		{
+		return *_topo;
+		}
+
+	/** Number of networks sharing this topology. */
+	long topology_use_count() const
+		{
+		return _topo.use_count();
+		}
+
+	/** Find index of link @a l (constant time). */
+	size_t find_link(const L * l) const
+		{
+		return l - link_data.data();
+		}
+
+	/** Find index of node @a n (constant time). */
+	size_t find_node_id(const N * n) const
+		{
+		return n - node_data.data();
+		}
+
+	/** All nodes in topological order (inputs before outputs). The order itself is part of 
+	 * the (shared) topology, only the pointers are set up on first use. Throws if the 
+	 * network contains cycles.
+	 * @pre build() has been called. */
+	const std::vector<N *> & topological_order()
+		{
+		myassert(_built);
+
+		const std::vector<size_t> & order = _topo->order;
+
+		if (_order.empty())
+			{
+			ensure(acyclic(), "Cycles in network detected");
+
+			_order.resize(order.size());
+			for (size_t i=0; i<order.size(); i++)
+				_order[i] = &node_data[order[i]];
+			}
+
+		return _order;
+		}
+
+	/** Whether the network is free of cycles (see topological_order).
+	 * @pre build() has been called. */
+	bool acyclic() const
+		{
+		myassert(_built);
+
+		return _topo->order.size() == node_data.size();
+		}
+
+	/** All nodes grouped by strongly connected component, components in topological order
+	 * (see strong_components in genericgraph.h). Like the topological order the components
+	 * are part of the (shared) topology, they are calculated by build().
+	 * @pre build() has been called and the network contains cycles. */
+	const std::vector<N *> & component_order()
+		{
+		myassert(_built && !acyclic());
+
+		const std::vector<size_t> & order = _topo->comp_order;
+
+		if (_comp_order.empty())
+			{
+			_comp_order.resize(order.size());
+			for (size_t i=0; i<order.size(); i++)
+				_comp_order[i] = &node_data[order[i]];
+			}
+
+		return _comp_order;
+		}
+
+	/** Start of each component in component_order() (plus the end of the last one).
+	 * @pre build() has been called and the network contains cycles. */
+	const std::vector<size_t> & component_offsets() const
+		{
+		myassert(_built && !acyclic());
+
+		return _topo->comp_offset;
+		}
+
+	/** Start of each level in topological_order() (plus the end of the last one). 
+	 * Nodes within a level are independent of each other.
+	 * @pre build() has been called. */
+	const std::vector<size_t> & level_offsets() const
+		{
+		myassert(_built);
+
+		return _topo->level_offset;
+		}
+
+protected:
+	/** Make sure we are the only owner of our topology. */
+	void detach()
+		{
+		if (_topo.use_count() > 1)
+			_topo = std::make_shared<CSRTopology>(*_topo);
+		}
+
+	/** Point node ranges and links to this network's arrays. */
+	void rewire()
+		{
+		update_node_ptrs();
+		_order.clear();
+		_comp_order.clear();
+
+		const CSRTopology & t = *_topo;
+		L * const lbase = link_data.data();
+
+		for (size_t i=0; i<node_data.size(); i++)
+			{
+			N & n = node_data[i];
+			n.inputs.base = lbase;
+			n.inputs.b = t.in_idx.data() + t.in_offset[i];
+			n.inputs.e = t.in_idx.data() + t.in_offset[i+1];
+			n.outputs.base = lbase;
+			n.outputs.b = t.out_idx.data() + t.out_offset[i];
+			n.outputs.e = t.out_idx.data() + t.out_offset[i+1];
+			}
+
+		links.resize(link_data.size());
+		for (size_t i=0; i<link_data.size(); i++)
+			{
+			link_data[i].from = &node_data[t.link_from[i]];
+			link_data[i].to = &node_data[t.link_to[i]];
+			links[i] = &link_data[i];
+			}
+		}
+
+	/** Refresh the list of node pointers. */
+	void update_node_ptrs()
+		{
+		// only re-point everything if storage has moved
+		const size_t start = 
+			nodes.size() && nodes[0] == node_data.data() ? nodes.size() : 0;
+
+		nodes.resize(node_data.size());
+		for (size_t i=start; i<node_data.size(); i++)
+			{
+			nodes[i] = &node_data[i];
+			nodes[i]->id = i;
+			}
+		}
+
+	std::shared_ptr<CSRTopology> _topo;
+	bool _built;
+	std::vector<N *> _order;	//!< nodes in topological order
+	std::vector<N *> _comp_order;	//!< nodes grouped by component
+	};
+
+
+#endif	// CSRNETWORK_H
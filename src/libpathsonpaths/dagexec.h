@@ -0,0 +1,257 @@
+#ifndef DAGEXEC_H
+#define DAGEXEC_H
+
+/** @file Parallel execution of per-node tasks in dependency order. */
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <exception>
+#include <stdexcept>
+
+#include "util.h"
+
+using std::size_t;
+
+
+/** Lock policy for kernels that modify nodes other than the one being processed (see 
+ * NoNodeLocks in genericgraph.h). Nodes are mapped onto a fixed number of mutexes by id. */
+class NodeLocks
+	{
+public:
+	explicit NodeLocks(size_t n_stripes = 256)
+		: _mutexes(new std::mutex[n_stripes]), _n(n_stripes)
+		{}
+
+	void lock(size_t id)
+		{
+		_mutexes[id % _n].lock();
+		}
+
+	void unlock(size_t id)
+		{
+		_mutexes[id % _n].unlock();
+		}
+
+protected:
+	std::unique_ptr<std::mutex[]> _mutexes;
+	size_t _n;
+	};
+
+
+/** Runs a task for every node of a DAG on several threads. Every node keeps a counter of
+ * unfinished inputs, a node becomes ready when the last of its inputs has finished. 
+ * Ready nodes go into the queue of the thread that finished the input, threads take work
+ * from the back of their own queue and, if that is empty, steal from the front of other 
+ * threads' queues. In contrast to processing the network level by level (see 
+ * parallel_levels in threadpool.h) there is no synchronization between levels, long 
+ * chains therefore don't hold up the rest of the network.
+ *
+ * Threads that run out of work sleep until another thread queues a node. If no node is
+ * ready or being processed while some are still left, these nodes are part of (or
+ * downstream of) a cycle and the run is aborted.
+ *
+ * Tasks for nodes that share an output may run at the same time, kernels that write to
+ * their output nodes have to use a lock policy (see NodeLocks). */
+class DAGExecutor
+	{
+public:
+	/** @param n_threads number of threads to use (including the calling thread). */
+	explicit DAGExecutor(size_t n_threads)
+		: _n_threads(n_threads > 0 ? n_threads : 1)
+		{}
+
+	size_t size() const
+		{
+		return _n_threads;
+		}
+
+	/** Call @a func(node) for all nodes. A node is only processed after all of its inputs.
+	 * Blocks until all nodes are done. Exceptions thrown by @a func are rethrown in the 
+	 * calling thread (remaining nodes are skipped in that case). Throws if the network 
+	 * has cycles (nodes that are not part of a cycle may have been processed by then).
+	 * @param nodes all nodes of a network, stored at the position of their id (null 
+	 * pointers are ignored). */
+	template<class NODE, class FUNC>
+	void run(const std::vector<NODE *> & nodes, FUNC func)
+		{
+		std::unique_ptr<std::atomic<size_t>[]> pending(new std::atomic<size_t>[nodes.size()]);
+		std::vector<Queue<NODE> > queues(_n_threads);
+
+		// distribute roots
+		size_t n_nodes = 0, q = 0;
+		for (NODE * n : nodes)
+			{
+			if (!n)
+				continue;
+
+			n_nodes++;
+			pending[n->id] = n->inputs.size();
+			if (n->is_root())
+				queues[q++ % _n_threads].items.push_back(n);
+			}
+
+		ensure(n_nodes == 0 || q > 0, "Cycles in network detected.");
+
+		std::atomic<size_t> remaining(n_nodes);
+		// nodes that are ready or being processed, if there are none left before all 
+		// nodes are done the rest can't become ready
+		std::atomic<size_t> active(q);
+		std::atomic<bool> abort(false);
+		std::exception_ptr error;
+		std::mutex error_mutex;
+
+		// idle threads wait for nodes to be queued (or for the end of the run)
+		std::atomic<size_t> n_queued(0);
+		std::atomic<size_t> n_sleeping(0);
+		std::mutex idle_mutex;
+		std::condition_variable idle;
+
+		auto wake_all = [&]()
+			{
+			std::lock_guard<std::mutex> lock(idle_mutex);
+			idle.notify_all();
+			};
+
+		auto work = [&](size_t t)
+			{
+			Queue<NODE> & own = queues[t];
+			// continue directly with one of the nodes that became ready, saves a
+			// round trip through the queue and keeps the working set small
+			NODE * n = 0;
+
+			while (remaining > 0 && !abort)
+				{
+				// anything queued after this has to wake us up
+				const size_t seen = n_queued;
+
+				if (!n)
+					n = own.pop_back();
+
+				for (size_t i=1; !n && i<_n_threads; i++)
+					n = queues[(t+i) % _n_threads].pop_front();
+
+				// nothing to do right now, wait for other threads to produce work
+				if (!n)
+					{
+					std::unique_lock<std::mutex> lock(idle_mutex);
+					n_sleeping++;
+					idle.wait(lock, [&]()
+						{return n_queued != seen || remaining == 0 || abort;});
+					n_sleeping--;
+					continue;
+					}
+
+				try {
+					func(n);
+					}
+				catch (...)
+					{
+					{
+					std::lock_guard<std::mutex> lock(error_mutex);
+					if (!error)
+						error = std::current_exception();
+					}
+					abort = true;
+					wake_all();
+					break;
+					}
+
+				NODE * next = 0;
+				for (auto l : n->outputs)
+					if (--pending[l->to->id] == 0)
+						{
+						active++;
+						if (next)
+							{
+							own.push_back(next);
+							n_queued++;
+							if (n_sleeping > 0)
+								{
+								std::lock_guard<std::mutex> lock(idle_mutex);
+								idle.notify_one();
+								}
+							}
+						next = l->to;
+						}
+
+				const bool last = --remaining == 0;
+				// nodes that became ready have been counted above
+				if (--active == 0 && !last)
+					{
+					{
+					std::lock_guard<std::mutex> lock(error_mutex);
+					if (!error)
+						error = std::make_exception_ptr(
+							std::runtime_error("Cycles in network detected."));
+					}
+					abort = true;
+					wake_all();
+					break;
+					}
+
+				if (last)
+					wake_all();
+				n = next;
+				}
+			};
+
+		std::vector<std::thread> threads;
+		for (size_t t=1; t<_n_threads; t++)
+			threads.emplace_back(work, t);
+
+		work(0);
+
+		for (auto & th : threads)
+			th.join();
+
+		if (error)
+			std::rethrow_exception(error);
+		}
+
+protected:
+	/** Queue of ready nodes of one thread. */
+	template<class NODE>
+	struct Queue
+		{
+		std::deque<NODE *> items;
+		std::mutex mutex;
+
+		void push_back(NODE * n)
+			{
+			std::lock_guard<std::mutex> lock(mutex);
+			items.push_back(n);
+			}
+
+		/** Owner's end. */
+		NODE * pop_back()
+			{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (items.empty())
+				return 0;
+			NODE * n = items.back();
+			items.pop_back();
+			return n;
+			}
+
+		/** Thieves' end. */
+		NODE * pop_front()
+			{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (items.empty())
+				return 0;
+			NODE * n = items.front();
+			items.pop_front();
+			return n;
+			}
+		};
+
+	size_t _n_threads;
+	};
+
+
+#endif	// DAGEXEC_H
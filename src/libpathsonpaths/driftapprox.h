@@ -3,40 +3,38 @@
 
 #include <numeric>
 
+#include "genericgraph.h"
+#include "genefreqgraph.h"
+
 /** Simulate genetic drift (or any other change in allele frequencies) for a node.
- * All unprocessed ancestors of this node will be processed recursively. This implementation
- * is deprecated.
+ * Pulls from the inputs (in the order of node->inputs) and only modifies the node 
+ * itself. Nodes can therefore be processed in parallel (see DAGExecutor) with results
+ * that don't depend on scheduling, as long as @a drift doesn't (e.g. one StreamRng per
+ * node).
+ * @pre All input nodes have been processed.
  * @param node The node to operate on.
  * @param drift A function object to simulate one step of change in allele frequencies. */
 template<class NODE, class DRIFT_FUNC>
 void annotate_frequencies(NODE * node, DRIFT_FUNC & drift)
 	{
-	if (node->done)
-		return;
-
 	if (node->is_root())
-		{
-		node->done = true;
 		return;
-		}
-
-	// do parents in any case (will immediately return if they are done already)
-	for (auto * link : node->inputs)
-		annotate_frequencies(link->from, drift);
 
 	// this node has been pre-set => no simulation
 	if (node->blocked) 
-		{
-		node->done = true;
 		return;
-		}
+
+	// we want even empty nodes to have a set of frequencies (see 
+	// annotate_frequencies_push)
+	if (node->frequencies.empty())
+		node->frequencies.resize(node->inputs[0]->from->frequencies.size(), 0);
 
 	// amount of incoming infected material
 	const double prop_in_infd = node->rate_in_infd - node->d_rate_in_infd;
 
 	// this is not very elegant, but I can't think of a better way to do it
 	// without creating lots of little vectors all the time
-	static typename NODE::freq_t res;
+	static thread_local typename NODE::freq_t res;
 
 	for (auto * link : node->inputs)
 		{
@@ -50,62 +48,52 @@ void annotate_frequencies(NODE * node, DRIFT_FUNC & drift)
 		res.resize(freq_in.size());
 
 		drift(freq_in, res);
-		// NOTE: any recursive calls will invalidate res!
-
-		// has to go here, otherwise we won't know size
-		if (node->frequencies.empty())
-			node->frequencies.resize(freq_in.size(), 0);
-
-		// doesn't look like it, but this is safe since res can never be bigger than
-		// node->frequencies (unless users supply differently sized allele freqs but
-		// then they are on their own)
-		auto f_iter = node->frequencies.begin();
-		for (const auto r : res)
-			 *f_iter++ += r * prop;
-		}
 
-	node->done = true;
+		// only alleles present in the input can be passed on
+		auto & freqs = node->frequencies;
+		for_each_allele(res, [&freqs, prop](size_t i, const typename NODE::value_t & r)
+			{
+			add_allele(freqs, i, typename NODE::value_t(r * prop));
+			});
+		}
 	}
 
 
 /** Simulate genetic drift (or any other change in allele frequencies) for a node.
- * All unprocessed ancestors of this node will be processed recursively. This is an 
- * alternative implementation that operates forward instead of backwards and could therefore
- * in the future be unified with the mechanistic simulation.
+ * This is an alternative implementation that operates forward instead of backwards and 
+ * could therefore in the future be unified with the mechanistic simulation.
+ * @pre All input nodes have been processed.
  * @param node The node to operate on.
- * @param drift A function object to simulate one step of change in allele frequencies. */
-template<class NODE, class DRIFT_FUNC>
-void annotate_frequencies_push(NODE * node, DRIFT_FUNC & drift)
+ * @param drift A function object to simulate one step of change in allele frequencies. 
+ * drift(freqs, res) stores the new frequencies in res (alleles that are absent in freqs
+ * have to stay absent).
+ * @param locks lock policy, protects output nodes against concurrent modification by
+ * their other inputs (see NoNodeLocks). Note that if nodes are processed in parallel 
+ * (see NodeLocks) the order in which inputs add to a node depends on scheduling, 
+ * results can therefore differ in the last digits between runs. Use the pull variant
+ * (annotate_frequencies) if results have to be reproducible. */
+template<class NODE, class DRIFT_FUNC, class LOCKS>
+void annotate_frequencies_push(NODE * node, DRIFT_FUNC & drift, LOCKS & locks)
 	{
-	if (node->done)
-		return;
-
-	// do parents in any case
-	for (auto l : node->inputs)
-		annotate_frequencies_push(l->from, drift);
-
 	// we want even empty nodes to have a set of frequencies
 	// so let's do that here
 	for (auto l : node->outputs)
+		{
+		NodeGuard<LOCKS> guard(locks, l->to->id);
 		l->to->frequencies.resize(node->frequencies.size(), 0.0);
+		}
 	
 	// we are pushing, so ignore leaves
 	if (node->is_leaf() || node->rate_in <= 0 || node->rate_in_infd <= 0)
-		{
-		node->done = true;
 		return;
-		}
 
 	// this branch of the graph is dead
 	if (node->frequencies.empty())
-		{
-		node->done = true;
 		return;
-		}
 
 	// this is not very elegant, but I can't think of a better way to do it
 	// without creating lots of little vectors all the time
-	static typename NODE::freq_t res;
+	static thread_local typename NODE::freq_t res;
 	res.resize(node->frequencies.size());
 
 	for (auto link : node->outputs)
@@ -126,28 +114,35 @@ void annotate_frequencies_push(NODE * node, DRIFT_FUNC & drift)
 		if (p_to <= 0) continue;
 
 		drift(node->frequencies, res);
-		// NOTE: any recursive calls will invalidate res!
-
-		// doesn't look like it, but this is safe since res can never be bigger than
-		// node->frequencies (unless users supply differently sized allele freqs but
-		// then they are on their own)
-		auto f_iter = to->frequencies.begin();
-		for (const auto r : res)
-			 *f_iter++ += r * p_to;
+
+		// other inputs of the target node might be running at the same time
+		NodeGuard<LOCKS> guard(locks, to->id);
+
+		// only alleles present in this node can be passed on
+		auto & freqs = to->frequencies;
+		for_each_allele(res, [&freqs, p_to](size_t i, const typename NODE::value_t & r)
+			{
+			add_allele(freqs, i, typename NODE::value_t(r * p_to));
+			});
 		}
+	}
 
-	node->done = true;
+/** Simulate genetic drift for a node (serial version, see above). */
+template<class NODE, class DRIFT_FUNC>
+void annotate_frequencies_push(NODE * node, DRIFT_FUNC & drift)
+	{
+	NoNodeLocks locks;
+	annotate_frequencies_push(node, drift, locks);
 	}
 
-/** Run genetics for a range of nodes. */
+/** Run genetics for a range of nodes. 
+ * @pre The range is sorted topologically and contains all ancestors of its nodes (see 
+ * Network::topological_order). */
 template<class ITER, class DRIFT_FUNC>
 void annotate_frequencies(const ITER & beg, const ITER & end, DRIFT_FUNC & drift)
 	{
 	for (ITER i=beg; i!=end; i++)
 		annotate_frequencies_push(*i, drift);
-
-	for (ITER i=beg; i!=end; i++)
-		(*i)->done = false;
 	}
 
 
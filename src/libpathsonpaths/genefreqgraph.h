@@ -2,8 +2,17 @@
 #define GENEFREQGRAPH_H
 
 #include <numeric>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
 
-/** A node class that keeps a list of allele frequencies. */
+#include "util.h"
+#include "proportionalpick.h"
+
+/** A node class that keeps a list of allele frequencies.
+ * @tparam CONT allele container, either a std::vector (one entry per allele) or a
+ * SparseFreqs. Kernels access it through the functions below (for_each_allele etc.), so
+ * that they only visit alleles that are present. */
 template<class CONT>
 struct FreqNode
 	{
@@ -35,4 +44,319 @@ struct FreqNode
 	};
 
 
+/** Allele frequencies (or counts) that only stores alleles that are present, as
+ * (allele, value) pairs sorted by allele. Meant for runs with many alleles that each
+ * occur in a small part of the network.
+ *
+ * size() is the overall number of alleles, as for a std::vector. Iterators only cover
+ * the stored values, which is all that sums and rescaling need. Stored values can
+ * become 0, they are only dropped by assign() and resize(). */
+template<class T>
+class SparseFreqs
+	{
+public:
+	typedef T value_type;
+	typedef typename std::vector<T>::iterator iterator;
+	typedef typename std::vector<T>::const_iterator const_iterator;
+
+	SparseFreqs()
+		: _n(0)
+		{}
+
+	/** Number of alleles (including absent ones). */
+	size_t size() const
+		{
+		return _n;
+		}
+
+	bool empty() const
+		{
+		return _n == 0;
+		}
+
+	/** Change the number of alleles, alleles >= @a n are dropped.
+	 * @param v has to be 0 (new alleles are absent). */
+	void resize(size_t n, T v = T(0))
+		{
+		myassert(v == T(0));
+
+		if (n < _n)
+			{
+			const size_t k = std::lower_bound(_idx.begin(), _idx.end(), n) - _idx.begin();
+			_idx.resize(k);
+			_val.resize(k);
+			}
+
+		_n = n;
+		}
+
+	/** @a n absent alleles.
+	 * @param v has to be 0. */
+	void assign(size_t n, T v)
+		{
+		myassert(v == T(0));
+
+		_idx.clear();
+		_val.clear();
+		_n = n;
+		}
+
+	/** Value of allele @a i (0 if absent). */
+	T operator[](size_t i) const
+		{
+		const auto p = std::lower_bound(_idx.begin(), _idx.end(), i);
+		return p == _idx.end() || *p != i ? T(0) : _val[p - _idx.begin()];
+		}
+
+	/** Set allele @a i to @a v. */
+	void set(size_t i, T v)
+		{
+		myassert(i < _n);
+
+		const auto p = std::lower_bound(_idx.begin(), _idx.end(), i);
+		const size_t k = p - _idx.begin();
+
+		if (p != _idx.end() && *p == i)
+			_val[k] = v;
+		else if (v != T(0))
+			{
+			_idx.insert(p, uint32_t(i));
+			_val.insert(_val.begin() + k, v);
+			}
+		}
+
+	/** Add @a v to allele @a i. */
+	void add(size_t i, T v)
+		{
+		myassert(i < _n);
+
+		// most additions go to the end (alleles are visited in order)
+		if (_idx.empty() || _idx.back() < i)
+			{
+			if (v != T(0))
+				{
+				_idx.push_back(uint32_t(i));
+				_val.push_back(v);
+				}
+			return;
+			}
+
+		const auto p = std::lower_bound(_idx.begin(), _idx.end(), i);
+		const size_t k = p - _idx.begin();
+
+		if (*p == i)
+			_val[k] += v;
+		else if (v != T(0))
+			{
+			_idx.insert(p, uint32_t(i));
+			_val.insert(_val.begin() + k, v);
+			}
+		}
+
+	/** Number of stored alleles. */
+	size_t n_stored() const
+		{
+		return _idx.size();
+		}
+
+	/** Allele of the @a k-th stored value. */
+	size_t allele(size_t k) const
+		{
+		return _idx[k];
+		}
+
+	/** Stored values, in the same order as the iterators. */
+	const std::vector<T> & values() const
+		{
+		return _val;
+		}
+
+	iterator begin() {return _val.begin();}
+	iterator end() {return _val.end();}
+	const_iterator begin() const {return _val.begin();}
+	const_iterator end() const {return _val.end();}
+
+	bool operator==(const SparseFreqs & other) const
+		{
+		return _n == other._n && _idx == other._idx && _val == other._val;
+		}
+
+protected:
+	std::vector<uint32_t> _idx;		//!< stored alleles, ascending
+	std::vector<T> _val;			//!< value per stored allele
+	size_t _n;						//!< number of alleles
+	};
+
+
+// *** uniform access to dense and sparse allele containers
+
+/** Call @a func(i, f) for all alleles i that are present, f is a reference to the
+ * allele's value. */
+template<class T, class FUNC>
+void for_each_allele(std::vector<T> & freqs, FUNC func)
+	{
+	for (size_t i=0; i<freqs.size(); i++)
+		if (freqs[i] != T(0))
+			func(i, freqs[i]);
+	}
+
+template<class T, class FUNC>
+void for_each_allele(const std::vector<T> & freqs, FUNC func)
+	{
+	for (size_t i=0; i<freqs.size(); i++)
+		if (freqs[i] != T(0))
+			func(i, freqs[i]);
+	}
+
+template<class T, class FUNC>
+void for_each_allele(SparseFreqs<T> & freqs, FUNC func)
+	{
+	size_t k = 0;
+	for (auto & f : freqs)
+		func(freqs.allele(k++), f);
+	}
+
+template<class T, class FUNC>
+void for_each_allele(const SparseFreqs<T> & freqs, FUNC func)
+	{
+	size_t k = 0;
+	for (const auto & f : freqs)
+		func(freqs.allele(k++), f);
+	}
+
+/** Number of alleles that for_each_allele visits. */
+template<class T>
+size_t n_present(const std::vector<T> & freqs)
+	{
+	return freqs.size() - std::count(freqs.begin(), freqs.end(), T(0));
+	}
+
+template<class T>
+size_t n_present(const SparseFreqs<T> & freqs)
+	{
+	return freqs.n_stored();
+	}
+
+/** Add @a v to allele @a i. */
+template<class T>
+void add_allele(std::vector<T> & freqs, size_t i, T v)
+	{
+	freqs[i] += v;
+	}
+
+template<class T>
+void add_allele(SparseFreqs<T> & freqs, size_t i, T v)
+	{
+	freqs.add(i, v);
+	}
+
+/** Set allele @a i to @a v. */
+template<class T>
+void set_allele(std::vector<T> & freqs, size_t i, T v)
+	{
+	freqs[i] = v;
+	}
+
+template<class T>
+void set_allele(SparseFreqs<T> & freqs, size_t i, T v)
+	{
+	freqs.set(i, v);
+	}
+
+
+/** Sum of squared differences between two sets of allele frequencies. */
+template<class T>
+double sum_sq_diff(const std::vector<T> & a, const std::vector<T> & b)
+	{
+	double d = 0.0;
+	for (size_t i=0; i<a.size(); i++)
+		d += (a[i] - b[i]) * (a[i] - b[i]);
+
+	return d;
+	}
+
+template<class T>
+double sum_sq_diff(const SparseFreqs<T> & a, const SparseFreqs<T> & b)
+	{
+	// both are sorted by allele, alleles missing in one of them contribute their square
+	const auto & va = a.values(), & vb = b.values();
+	double d = 0.0;
+	size_t i = 0, j = 0;
+	while (i < a.n_stored() && j < b.n_stored())
+		{
+		const size_t ai = a.allele(i), bj = b.allele(j);
+		const double x = ai <= bj ? va[i++] : 0.0;
+		const double y = bj <= ai ? vb[j++] : 0.0;
+		d += (x - y) * (x - y);
+		}
+	for (; i<a.n_stored(); i++)
+		d += va[i] * va[i];
+	for (; j<b.n_stored(); j++)
+		d += vb[j] * vb[j];
+
+	return d;
+	}
+
+/** Sum of products of allele frequencies (i.e. the probability that two units drawn
+ * from @a a and @a b have the same allele). */
+template<class T>
+double sum_prod(const std::vector<T> & a, const std::vector<T> & b)
+	{
+	double d = 0.0;
+	for (size_t i=0; i<a.size(); i++)
+		d += a[i] * b[i];
+
+	return d;
+	}
+
+template<class T>
+double sum_prod(const SparseFreqs<T> & a, const SparseFreqs<T> & b)
+	{
+	double d = 0.0;
+
+	size_t j = 0;
+	for (size_t i=0; i<a.n_stored(); i++)
+		{
+		while (j < b.n_stored() && b.allele(j) < a.allele(i))
+			j++;
+		if (j < b.n_stored() && b.allele(j) == a.allele(i))
+			d += a.values()[i] * b.values()[j];
+		}
+
+	return d;
+	}
+
+
+/** Draws alleles in proportion to their frequencies (see ProportionalPick). Only
+ * alleles that are present are set up, if all frequencies are (close to) 0 any allele
+ * can be drawn. */
+template<class CONT>
+class AllelePick
+	{
+public:
+	AllelePick(const CONT & freqs, double delta)
+		: _freqs(freqs), _pick(delta)
+		{
+		for_each_allele(freqs, [this](size_t i, const typename CONT::value_type & f)
+			{
+			_alleles.push_back(i);
+			_weights.push_back(f);
+			});
+		_pick.setup(_weights.begin(), _weights.end());
+		}
+
+	template<class RNG>
+	size_t pick(RNG & rng) const
+		{
+		return _alleles.empty() ? rng(_freqs.size()) : _alleles[_pick.pick(rng)];
+		}
+
+protected:
+	const CONT & _freqs;
+	std::vector<size_t> _alleles;
+	std::vector<double> _weights;
+	ProportionalPick<> _pick;
+	};
+
+
 #endif	// GENEFREQGRAPH_H
@@ -1,6 +1,14 @@
 #ifndef GENERICGRAPH_H
 #define GENERICGRAPH_H
 
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+#include "arena.h"
+
+using std::size_t;
+
 /** Generic Link type.
  * @tparam GRAPH helper class that provides the node type.
  */
@@ -12,8 +20,10 @@ struct Link
 
 	node_t * from, * to;
 
+	size_t id;	//!< index of this link in its network
+
 	Link(node_t * f = 0, node_t * t = 0)
-		: from(f), to(t)
+		: from(f), to(t), id(0)
 		{}
 	};
 
@@ -32,10 +42,10 @@ struct Node
 	cont_t inputs;
 	cont_t outputs;
 
-	bool done;
+	size_t id;	//!< index of this node in its network
 
 	Node()
-		: inputs(), outputs(), done(false)
+		: inputs(), outputs(), id(0)
 		{}
 
 	void add_input(link_t * inp)
@@ -47,6 +57,19 @@ struct Node
 		outputs.push_back(outp);
 		}
 
+	/** Add an input using allocation policy @a alloc (see arena.h). */
+	template<class ALLOC>
+	void add_input(link_t * inp, ALLOC & alloc)
+		{
+		seq_push_back(inputs, inp, alloc);
+		}
+	/** Add an output using allocation policy @a alloc (see arena.h). */
+	template<class ALLOC>
+	void add_output(link_t * outp, ALLOC & alloc)
+		{
+		seq_push_back(outputs, outp, alloc);
+		}
+
 	/** Find a link in container @a c that connects to Node @a to.
 	 * @tparam FORWARD whether the link is a forward or a backward link.
 	 */
@@ -135,63 +158,432 @@ struct Graph
 	};
 	
 
-/** Reset NODE::done in this and all downstream nodes. */
+/** Lock policy for kernels that modify nodes other than the one being processed. This
+ * one does nothing and is used for serial execution (see NodeLocks in dagexec.h for the
+ * parallel case). */
+struct NoNodeLocks
+	{
+	void lock(size_t) {}
+	void unlock(size_t) {}
+	};
+
+/** Holds the lock for a node for the lifetime of the guard. */
+template<class LOCKS>
+struct NodeGuard
+	{
+	LOCKS & locks;
+	const size_t id;
+
+	NodeGuard(LOCKS & l, size_t i)
+		: locks(l), id(i)
+		{
+		locks.lock(id);
+		}
+
+	~NodeGuard()
+		{
+		locks.unlock(id);
+		}
+
+	NodeGuard(const NodeGuard &) = delete;
+	NodeGuard & operator=(const NodeGuard &) = delete;
+	};
+
+
+/** Sort nodes topologically (Kahn's algorithm), i.e. every node comes after all of its 
+ * inputs. Nodes are expected to be stored at the position of their id, null pointers are
+ * ignored. 
+ *
+ * The result is grouped into levels, nodes in a level only depend on nodes in
+ * previous levels (and can therefore be processed in parallel).
+ * @param nodes all nodes of a network.
+ * @param order receives the sorted nodes.
+ * @param level_offset receives the start of each level in @a order (plus the end of the 
+ * last one).
+ * @return false if the network contains cycles (nodes in cycles are missing from 
+ * @a order in that case). */
 template<class NODE>
-void reset_downstream(NODE & node, bool to=false)
+bool topological_sort(const std::vector<NODE *> & nodes, std::vector<NODE *> & order,
+	std::vector<size_t> & level_offset)
 	{
-	node.done = to;
+	// number of unprocessed inputs per node
+	std::vector<size_t> n_inputs(nodes.size(), 0);
+
+	order.clear();
+	order.reserve(nodes.size());
+
+	size_t n_nodes = 0;
+	for (NODE * n : nodes)
+		{
+		if (!n)
+			continue;
+
+		n_nodes++;
+		n_inputs[n->id] = n->inputs.size();
+		if (n->is_root())
+			order.push_back(n);
+		}
+
+	level_offset.assign(1, 0);
 
-	for (auto l : node.outputs)
-		reset_downstream(*l->to, to);
+	// order doubles as queue; nodes that become ready while processing a level
+	// have their last input in that level and therefore make up the next one
+	for (size_t b=0; b<order.size(); )
+		{
+		const size_t e = order.size();
+		for (size_t i=b; i<e; i++)
+			for (auto l : order[i]->outputs)
+				if (--n_inputs[l->to->id] == 0)
+					order.push_back(l->to);
+
+		level_offset.push_back(e);
+		b = e;
+		}
+
+	return order.size() == n_nodes;
 	}
 
-/** Reset NODE::done in this and all upstream nodes. */
+
+/** Find the strongly connected components of a network (Tarjan's algorithm, using an 
+ * explicit stack). Collapsing each component into a single node yields a DAG, components
+ * are returned in topological order of that DAG, i.e. every component comes after all
+ * components it receives input from. Nodes that are not part of a cycle end up in a 
+ * component of their own. Within a component nodes are in order of discovery.
+ * @param nodes all nodes of a network, stored at the position of their id (null 
+ * pointers are ignored).
+ * @param order receives all nodes, grouped by component.
+ * @param comp_offset receives the start of each component in @a order (plus the end of 
+ * the last one).
+ * @return the number of components. */
 template<class NODE>
-void reset_upstream(NODE & node, bool to=false)
+size_t strong_components(const std::vector<NODE *> & nodes, std::vector<NODE *> & order,
+	std::vector<size_t> & comp_offset)
 	{
-	node.done = to;
+	const size_t none = size_t(-1);
 
-	for (auto l : node.inputs)
-		reset_upstream(*l->from, to);
+	// discovery index and lowest index reachable via the current path, kept together
+	// so that visiting a node only touches one entry
+	struct Visit
+		{
+		size_t index, low;
+		};
+
+	// low is set to none once a node's component is complete, i.e. it is not on the
+	// stack anymore
+	std::vector<Visit> visits(nodes.size(), {none, 0});
+	// nodes of unfinished components
+	std::vector<NODE *> stack;
+
+	// components in reverse topological order
+	std::vector<NODE *> found;
+	std::vector<size_t> found_offset(1, 0);
+
+	// node and index of the next output to process
+	struct Frame
+		{
+		NODE * node;
+		size_t next;
+		};
+
+	std::vector<Frame> path;
+	size_t counter = 0;
+
+	auto discover = [&](NODE * n)
+		{
+		visits[n->id] = {counter, counter};
+		counter++;
+		stack.push_back(n);
+		path.push_back({n, 0});
+		};
+
+	for (NODE * start : nodes)
+		{
+		if (!start || visits[start->id].index != none)
+			continue;
+
+		discover(start);
+
+		while (!path.empty())
+			{
+			Frame & f = path.back();
+			NODE * n = f.node;
+
+			if (f.next < n->outputs.size())
+				{
+				NODE * next = n->outputs[f.next]->to;
+				f.next++;
+
+				const Visit & v = visits[next->id];
+				// f is invalid after this
+				if (v.index == none)
+					discover(next);
+				// still on the stack
+				else if (v.low != none)
+					visits[n->id].low = std::min(visits[n->id].low, v.index);
+
+				continue;
+				}
+
+			// all outputs done
+			path.pop_back();
+			Visit & vn = visits[n->id];
+			if (!path.empty())
+				{
+				Visit & vp = visits[path.back().node->id];
+				vp.low = std::min(vp.low, vn.low);
+				}
+
+			// n is the first node of its component that has been discovered, the 
+			// component consists of n and all nodes above it on the stack
+			if (vn.low == vn.index)
+				{
+				size_t b = stack.size();
+				do	{
+					visits[stack[--b]->id].low = none;
+					} while (stack[b] != n);
+
+				found.insert(found.end(), stack.begin()+b, stack.end());
+				found_offset.push_back(found.size());
+				stack.resize(b);
+				}
+			}
+		}
+
+	// components have been found sinks first
+	order.clear();
+	order.reserve(found.size());
+	comp_offset.assign(1, 0);
+	for (size_t c=found_offset.size()-1; c>0; c--)
+		{
+		order.insert(order.end(), 
+			found.begin()+found_offset[c-1], found.begin()+found_offset[c]);
+		comp_offset.push_back(order.size());
+		}
+
+	return comp_offset.size() - 1;
 	}
 
-/** Apply a function to this and all downstream nodes. Uses NODE::done. */
-template<bool PREORDER=true, class NODE, class FUNC>
-void apply_downstream(NODE & node, FUNC func)
+
+/** Visitation marks for traversals, indexed by node id. Marks are kept outside of the 
+ * nodes, so that independent traversals (each with its own VisitMarks) can run on the 
+ * same network at the same time. A mark is the epoch in which a node has been visited, 
+ * clearing all marks therefore only increments the current epoch. */
+class VisitMarks
 	{
-	if (node.done)
-		return;
+public:
+	explicit VisitMarks(size_t n_nodes = 0)
+		: _marks(n_nodes, 0), _epoch(1)
+		{}
 
-	node.done = true;
+	/** Unmark all nodes (constant time). */
+	void clear()
+		{
+		// wrapped around, start over
+		if (++_epoch == 0)
+			{
+			std::fill(_marks.begin(), _marks.end(), 0);
+			_epoch = 1;
+			}
+		}
 
+	/** Whether node @a id is marked. */
+	bool visited(size_t id) const
+		{
+		return id < _marks.size() && _marks[id] == _epoch;
+		}
+
+	/** Mark node @a id. 
+	 * @return false if it had been marked already. */
+	bool visit(size_t id)
+		{
+		if (id >= _marks.size())
+			_marks.resize(id+1, 0);
+
+		if (_marks[id] == _epoch)
+			return false;
+
+		_marks[id] = _epoch;
+		return true;
+		}
+
+	/** Mark or unmark node @a id. */
+	void set(size_t id, bool to)
+		{
+		if (id >= _marks.size())
+			_marks.resize(id+1, 0);
+
+		_marks[id] = to ? _epoch : 0;
+		}
+
+	size_t size() const
+		{
+		return _marks.size();
+		}
+
+protected:
+	std::vector<unsigned> _marks;
+	unsigned _epoch;
+	};
+
+
+/** Depth-first traversal starting at @a start. Uses an explicit stack instead of recursion,
+ * so the depth of a network is only limited by available memory. Nodes are visited in the
+ * same order as by the equivalent recursive function.
+ * @tparam FORWARD whether to follow outputs (downstream) or inputs (upstream).
+ * @tparam PREORDER whether to call @a func before or after a node's neighbours.
+ * @param enter called when a node is reached, returns whether to descend into it.
+ * @param func called for each node that has been entered. */
+template<bool FORWARD, bool PREORDER, class NODE, class ENTER, class FUNC>
+void depth_first(NODE & start, ENTER enter, FUNC func)
+	{
+	// node and index of the next neighbour to process
+	struct Frame 
+		{
+		NODE * node;
+		size_t next;
+		};
+
+	std::vector<Frame> stack;
+
+	if (!enter(start))
+		return;
 	if (PREORDER)
-		func(node);
+		func(start);
+	stack.push_back({&start, 0});
+
+	while (!stack.empty())
+		{
+		Frame & f = stack.back();
+		const auto & cont = FORWARD ? f.node->outputs : f.node->inputs;
+
+		// all neighbours done
+		if (f.next == cont.size())
+			{
+			NODE * n = f.node;
+			// f is invalid after this
+			stack.pop_back();
+			if (!PREORDER)
+				func(*n);
+			continue;
+			}
+
+		NODE * next = FORWARD ? cont[f.next]->to : cont[f.next]->from;
+		f.next++;
+
+		if (!enter(*next))
+			continue;
+		if (PREORDER)
+			func(*next);
+		stack.push_back({next, 0});
+		}
+	}
+
+
+/** Reset marks of this and all downstream nodes. Every node is visited once, 
+ * independent of the number of paths leading to it.
+ * @param reached scratch marks, cleared (constant time) and reused by every call.
+ * @param to whether nodes should end up marked or unmarked. */
+template<class NODE>
+void reset_downstream(NODE & node, VisitMarks & marks, VisitMarks & reached, bool to=false)
+	{
+	reached.clear();
+
+	depth_first<true, true>(node, 
+		[&](NODE & n) -> bool
+			{
+			if (!reached.visit(n.id)) return false;
+			marks.set(n.id, to); return true;
+			}, 
+		[](NODE &){});
+	}
+
+/** Reset marks of this and all downstream nodes, using scratch marks that are kept 
+ * per thread. */
+template<class NODE>
+void reset_downstream(NODE & node, VisitMarks & marks, bool to=false)
+	{
+	static thread_local VisitMarks reached;
+	reset_downstream(node, marks, reached, to);
+	}
+
+/** Reset marks of this and all upstream nodes. Every node is visited once,
+ * independent of the number of paths leading to it.
+ * @param reached scratch marks, cleared (constant time) and reused by every call.
+ * @param to whether nodes should end up marked or unmarked. */
+template<class NODE>
+void reset_upstream(NODE & node, VisitMarks & marks, VisitMarks & reached, bool to=false)
+	{
+	reached.clear();
+
+	depth_first<false, true>(node, 
+		[&](NODE & n) -> bool
+			{
+			if (!reached.visit(n.id)) return false;
+			marks.set(n.id, to); return true;
+			}, 
+		[](NODE &){});
+	}
+
+/** Reset marks of this and all upstream nodes, using scratch marks that are kept 
+ * per thread. */
+template<class NODE>
+void reset_upstream(NODE & node, VisitMarks & marks, bool to=false)
+	{
+	static thread_local VisitMarks reached;
+	reset_upstream(node, marks, reached, to);
+	}
 
-	for (auto l : node.outputs)
-		apply_downstream(*l->to, func);
+/** Apply a function to this and all downstream nodes. Nodes that are already marked 
+ * in @a marks are skipped, all nodes processed are marked. */
+template<bool PREORDER=true, class NODE, class FUNC>
+void apply_downstream(NODE & node, FUNC func, VisitMarks & marks)
+	{
+	depth_first<true, PREORDER>(node, 
+		[&marks](NODE & n) -> bool {return marks.visit(n.id);}, func);
+	}
 
-	if (!PREORDER)
-		func(node);
+/** Apply a function to this and all downstream nodes. */
+template<bool PREORDER=true, class NODE, class FUNC>
+void apply_downstream(NODE & node, FUNC func)
+	{
+	VisitMarks marks;
+	apply_downstream<PREORDER>(node, func, marks);
 	}
 
 
-/** Apply a function to this and all upstream nodes. Uses NODE::done. */
+/** Apply a function to this and all upstream nodes. Nodes that are already marked 
+ * in @a marks are skipped, all nodes processed are marked. */
+template<bool PREORDER=true, class NODE, class FUNC>
+void apply_upstream(NODE & node, FUNC func, VisitMarks & marks)
+	{
+	depth_first<false, PREORDER>(node, 
+		[&marks](NODE & n) -> bool {return marks.visit(n.id);}, func);
+	}
+
+/** Apply a function to this and all upstream nodes. */
 template<bool PREORDER=true, class NODE, class FUNC>
 void apply_upstream(NODE & node, FUNC func)
 	{
-	if (node.done)
-		return;
+	VisitMarks marks;
+	apply_upstream<PREORDER>(node, func, marks);
+	}
 
-	node.done = true;
 
-	if (PREORDER)
-		func(node);
+/** Collect the nodes in [beg, end) and all nodes downstream of them in topological order
+ * (reverse postorder of a depth-first traversal). Only the affected part of the network
+ * is visited. Nodes that are already marked in @a marks are skipped, all nodes 
+ * collected are marked.
+ * @pre The network has no cycles. */
+template<class ITER, class NODE>
+void downstream_order(const ITER & beg, const ITER & end, std::vector<NODE *> & order,
+	VisitMarks & marks)
+	{
+	order.clear();
 
-	for (auto l : node.inputs)
-		apply_upstream(*l->from, func);
+	for (ITER i=beg; i!=end; i++)
+		apply_downstream<false>(**i, [&order](NODE & n){order.push_back(&n);}, marks);
 
-	if (!PREORDER)
-		func(node);
+	std::reverse(order.begin(), order.end());
 	}
 
 #endif	// GENERICGRAPH_H
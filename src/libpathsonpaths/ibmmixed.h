@@ -3,36 +3,30 @@
 
 #include <vector>
 #include <numeric>
+#include <algorithm>
 
 #include "util.h"
+#include "genericgraph.h"
+#include "genefreqgraph.h"
 
-/** Run mechanistic infection and spread simulation on node (and ancestors). */
+/** Run mechanistic infection and spread simulation on node. 
+ * @pre All input nodes have been processed. */
 template<class NODE, class RNG>
 void annotate_rates_ibmm(NODE * node, double transm_rate, RNG & rng)
 	{
-	if (node->done)
-		return;
-
 // *** collect input
 
 	if (!node->is_root())
 		node->rate_in = node->rate_in_infd = 0;
 
-	// this needs to be done first to make sure we get the whole network set up
-	// properly
 	for (auto link : node->inputs)
 		{
-		annotate_rates_ibmm(link->from, transm_rate, rng);
-
 		node->rate_in += link->rate;
 		node->rate_in_infd += link->rate_infd;
 		}
 
 	if (node->rate_in_infd <= 0)
-		{
-		node->done = true;
 		return;
-		}
 
 	const int in_infd = node->rate_in_infd;
 	//const int inp = node->rate_in;
@@ -65,10 +59,7 @@ void annotate_rates_ibmm(NODE * node, double transm_rate, RNG & rng)
 
 	// no output, done
 	if (outp <= 0)
-		{
-		node->done = true;
 		return;
-		}
 
 // *** generate output
 //
@@ -99,20 +90,17 @@ void annotate_rates_ibmm(NODE * node, double transm_rate, RNG & rng)
 	// adjust output rates in the node
 	for (const auto & l : node->outputs)
 		node->rate_out_infd += l->rate_infd;
-
-	node->done = true;
 	}
 
 
-/** Run mechanistic infection and spread simulation on a range of nodes. */
+/** Run mechanistic infection and spread simulation on a range of nodes. 
+ * @pre The range is sorted topologically and contains all ancestors of its nodes (see 
+ * Network::topological_order). */
 template<class ITER, class RNG>
 void annotate_rates_ibmm(const ITER & beg, const ITER & end, double transm_rate, RNG & rng)
 	{
 	for (ITER i=beg; i!=end; i++)
 		annotate_rates_ibmm(*i, transm_rate, rng);
-
-	for (ITER i=beg; i!=end; i++)
-		(*i)->done = false;
 	}
 
 
@@ -127,7 +115,8 @@ void freq_to_popsize_ibmm(NODE * node, RNG & rng)
 
 	if (n <= 0)
 		{
-		std::fill(node->frequencies.begin(), node->frequencies.end(), 0.0);
+		for (auto & f : node->frequencies)
+			f = 0;
 		return;
 		}
 
@@ -140,25 +129,35 @@ void freq_to_popsize_ibmm(NODE * node, RNG & rng)
 	if (rem <= 0 || (n>1 && rem == n))
 		return;
 
-	for (size_t i=0; i<node->frequencies.size()-1; i++)
+	typedef typename NODE::value_t value_t;
+
+	// the last allele present gets the remainder
+	size_t left = n_present(node->frequencies);
+
+	for_each_allele(node->frequencies, [&](size_t, value_t & f)
 		{
-		const double p = node->frequencies[i];
+		const double p = f;
+
+		// R binom does weird stuff when rem and p are very close so we
+		// skip the last step and just assign n directly
+		if (--left == 0)
+			{
+			ensure(n>=0 && rem-p>-0.0001, "internal error while scaling frequencies"); 
+			f = n;
+			return;
+			}
+
 		// due to numeric effects it can happen that p>rem (slightly)
 		// if this is the last positive frequency
 		const int add = n>0 && rem >0 ? rng.binom(std::min(1.0, p/rem), n) : 0;
 
 		ensure(add >= 0, "internal error while scaling frequencies");
 
-		node->frequencies[i] = add;
+		f = add;
 
 		n -= add;
 		rem -= p;
-		}
-
-	ensure(n>=0 && rem>-0.0001, "internal error while scaling frequencies"); 
-	// R binom does weird stuff when rem and p are very close so we
-	// skip the last step and just assign n directly
-	node->frequencies.back() = n;
+		});
 	}
 
 
@@ -171,36 +170,115 @@ void freq_to_popsize_ibmm(const ITER & beg, const ITER & end, BINOM_FUNC & binom
 		freq_to_popsize_ibmm(*i, binom);
 	}
 
-/** Run mechanistic genetics simulation. */
-template<class NODE, class RNG>
-void annotate_frequencies_ibmm(NODE * node, RNG & rng)
+/** Splits a pool of units of several kinds (alleles) into groups drawn without 
+ * replacement (multivariate hypergeometric distribution, using the conditional method,
+ * i.e. one hypergeometric draw per kind). Kinds are visited by decreasing count and 
+ * empty kinds are dropped, so that most draws are done after a few kinds. Buffers are 
+ * kept from one pool to the next. */
+class MultiHypergeom
 	{
-	if (node->done)
-		return;
+public:
+	/** Set up a new pool with @a counts[i] units of kind i. */
+	template<class CONT>
+	void init(const CONT & counts)
+		{
+		_kinds.clear();
+		_left = 0;
 
-	// this needs to be done first to make sure we get the whole network set up
-	// properly
-	for (auto link : node->inputs)
-		annotate_frequencies_ibmm(link->from, rng);
+		for_each_allele(counts, [this](size_t i, const typename CONT::value_type & f)
+			{
+			const int c = int(f);
+			if (c > 0)
+				{
+				_kinds.push_back({i, c});
+				_left += c;
+				}
+			});
+
+		std::sort(_kinds.begin(), _kinds.end(), [](const Kind & a, const Kind & b)
+			{return a.count > b.count || (a.count == b.count && a.id < b.id);});
+		}
+
+	/** Number of units left in the pool. */
+	int left() const
+		{
+		return _left;
+		}
+
+	/** Remove @a n units from the pool, calls @a add(i, k) for every kind i that 
+	 * k > 0 of them belong to. */
+	template<class RNG, class FUNC>
+	void draw(int n, RNG & rng, FUNC add)
+		{
+		myassert(n >= 0 && n <= _left);
+
+		// units of the kinds after the current one
+		int rest = _left;
+		bool emptied = false;
+
+		_left -= n;
+
+		for (auto & k : _kinds)
+			{
+			if (n == 0)
+				break;
+
+			rest -= k.count;
+
+			// the last kind gets the leftovers
+			const int x = rest > 0 ? rng.hypergeom(k.count, rest, n) : n;
+			myassert(x >= 0 && x <= k.count);
 
+			if (x == 0)
+				continue;
+
+			k.count -= x;
+			n -= x;
+			emptied = emptied || k.count == 0;
+
+			add(k.id, x);
+			}
+
+		if (emptied)
+			_kinds.erase(std::remove_if(_kinds.begin(), _kinds.end(), 
+				[](const Kind & k){return k.count == 0;}), _kinds.end());
+		}
+
+protected:
+	struct Kind
+		{
+		size_t id;
+		int count;
+		};
+
+	std::vector<Kind> _kinds;
+	int _left = 0;
+	};
+
+
+/** Run mechanistic genetics simulation on node (pushes to its outputs). 
+ * @pre All input nodes have been processed. 
+ * @param locks lock policy, protects output nodes against concurrent modification by
+ * their other inputs (see NoNodeLocks). Units are passed on as whole numbers, the 
+ * order in which inputs add to a node therefore doesn't change the result. */
+template<class NODE, class RNG, class LOCKS>
+void annotate_frequencies_ibmm(NODE * node, RNG & rng, LOCKS & locks)
+	{
 	// we want even empty nodes to have a set of frequencies
 	// so let's do that here
 	for (auto l : node->outputs)
+		{
+		NodeGuard<LOCKS> guard(locks, l->to->id);
 		l->to->frequencies.resize(node->frequencies.size(), 0.0);
+		}
 
 	// we are pushing, so ignore leaves
 	if (node->is_leaf() || node->rate_in <= 0)
-		{
-		node->done = true;
 		return;
-		}
 
 	// no input set on this branch
 	if (node->frequencies.empty())
-		{
-		node->done = true;
 		return;
-		}
 
 	double outp = 0.0;
 	for (const auto & l : node->outputs)
@@ -208,10 +286,7 @@ void annotate_frequencies_ibmm(NODE * node, RNG & rng)
 
 	// no output, done
 	if (outp <= 0)
-		{
-		node->done = true;
 		return;
-		}
 
 	ensure(outp <= node->rate_in, "output can't be bigger than input");
 
@@ -222,10 +297,7 @@ void annotate_frequencies_ibmm(NODE * node, RNG & rng)
 
 	// nothing infected, done
 	if (infd <= 0)
-		{
-		node->done = true;
 		return;
-		}
 
 	const double inp = node->rate_in;
 	const int newly_infd = int(node->d_rate_in_infd);
@@ -242,103 +314,186 @@ void annotate_frequencies_ibmm(NODE * node, RNG & rng)
 	// multinomial assumes that all infections happen simultaneously
 	if (newly_infd > 0)
 		{
+		typedef typename NODE::value_t value_t;
+
 		int n = newly_infd;
 		// tracks sum(freq[i..n])
 		int infd_left = infd;
+		// the last allele present gets the remainder
+		size_t left = n_present(node->frequencies);
 
-		for (size_t i=0; i<node->frequencies.size()-1; i++)
+		for_each_allele(node->frequencies, [&](size_t, value_t & f)
 			{
-			const double p = node->frequencies[i] / infd_left;
+			// done as soon as all newly infected have been assigned
+			if (n == 0)
+				return;
+
+			// R binom does weird stuff when rem and p are very close so we
+			// skip the last step and just assign n directly
+			if (--left == 0)
+				{
+				f += n;
+				n = 0;
+				return;
+				}
+
+			const double p = f / infd_left;
 			// due to numeric effects it can happen that p>rem (slightly)
 			// if this is the last positive frequency
-			const int add = n>0 ? rng.binom(std::min(1.0, p), n) : 0;
+			const int add = rng.binom(std::min(1.0, p), n);
 
 			myassert(add >= 0);
 
-			infd_left -= node->frequencies[i];
-			node->frequencies[i] += add;
+			infd_left -= f;
+			f += add;
 			n -= add;
-			}
+			});
 
-		myassert(n>=0); 
-		// R binom does weird stuff when rem and p are very close so we
-		// skip the last step and just assign n directly
-		node->frequencies.back() += n;
+		myassert(n==0); 
 		}
 
 // *** generate output
 //
 // We don't replace units that have been selected for output => we have to 
-// use a multi-variate hypergeometric distribution (we actually use a regular 
-// hypergeometric and the conditional method).
+// use a multi-variate hypergeometric distribution. All outputs are drawn from the
+// same pool one after the other.
 
-	// we have to keep track of how many infected there are still left
-	// left_all == sum(node->frequencies)
-	double left_all = node->rate_in_infd;
-	auto left_by_gene = node->frequencies;
+	// the pool is reused for all nodes processed by this thread
+	static thread_local MultiHypergeom pool;
+	pool.init(node->frequencies);
+
+	myassert(pool.left() == int(node->rate_in_infd));
 
 	for (auto l : node->outputs)
 		{
 		// how many infd go into this link (uninfd have been done by annotate_rates)
 		// needs to be an int, otherwise we'll get into trouble b/c rounding errors
-		int pick = int(l->rate_infd);
+		const int pick = int(l->rate_infd);
 
 		// link rate might be 0
 		if (pick == 0) continue;
 		myassert(pick > 0);
 
-		// how many to pick from for the remaining alleles
-		double all_infd = left_all;
+		// other inputs of the target node might be running at the same time
+		NodeGuard<LOCKS> guard(locks, l->to->id);
 
-		// first n-1 alleles
-		for (size_t i=0; i<left_by_gene.size()-1; i++)
+		auto * to = l->to;
+		pool.draw(pick, rng, [to](size_t i, int n)
 			{
-			myassert(pick <= all_infd);
-
-			// split leftover into two groups
-			all_infd -= left_by_gene[i];
-			
-			myassert(all_infd >= 0);
-
-			// picked units are either allele i or allele >i
-			const int add = rng.hypergeom(int(left_by_gene[i]), int(all_infd), int(pick));
-			
-			myassert(add >= 0);
-			// adjust number to pick from for the next output
-			left_by_gene[i] -= add;
-			myassert(left_by_gene[i] >= 0);
-			// keep this synchronized with left_by_gene
-			left_all -= add;
-			myassert(left_all >= 0);
-			// we pick less next time
-			pick -= add;
-			myassert(pick >= 0);
-			if (!l->to->blocked)
-				// add the stuff to the link and its end node
-				l->to->frequencies[i] += add;
-			}
-
-		if (!l->to->blocked)
-			// last allele gets the leftovers
-			l->to->frequencies.back() += pick;
-		// keep track
-		left_all -= pick;
-		left_by_gene.back() -= pick;
+			if (!to->blocked)
+				add_allele(to->frequencies, i, typename NODE::value_t(n));
+			});
 		}
+	}
 
-	node->done = true;
+/** Run mechanistic genetics simulation on node (pushes to its outputs). 
+ * @pre All input nodes have been processed. */
+template<class NODE, class RNG>
+void annotate_frequencies_ibmm(NODE * node, RNG & rng)
+	{
+	NoNodeLocks locks;
+	annotate_frequencies_ibmm(node, rng, locks);
 	}
 
 
-/** Run mechanistic genetics simulation on a range of nodes. */
+/** Run mechanistic genetics simulation on a range of nodes. 
+ * @pre The range is sorted topologically and contains all ancestors of its nodes (see 
+ * Network::topological_order). */
 template<class ITER, class BINOM_FUNC>
 void annotate_frequencies_ibmm(const ITER & beg, const ITER & end, BINOM_FUNC & binom)
 	{
 	for (ITER i=beg; i!=end; i++)
 		annotate_frequencies_ibmm(*i, binom);
+	}
+
+
+/** Run the complete mechanistic genetics simulation (see simulate_genetics_ibmm) for 
+ * a single node: scale to absolute numbers, push to the outputs and scale back. Nodes
+ * can be processed in parallel (see DAGExecutor), results don't depend on scheduling as 
+ * long as @a rng doesn't (e.g. one StreamRng per node).
+ * @pre All input nodes have been processed.
+ * @param locks lock policy (see annotate_frequencies_ibmm). */
+template<class NODE, class RNG, class LOCKS>
+void genetics_ibmm(NODE * node, RNG & rng, LOCKS & locks)
+	{
+	// only changes pre-set nodes, all others have received absolute numbers by now
+	freq_to_popsize_ibmm(node, rng);
+	annotate_frequencies_ibmm(node, rng, locks);
 
+	// the node doesn't change anymore once it has pushed to its outputs
+	node->normalize();
+	}
+
+
+/** Run the complete mechanistic genetics simulation on a network: scale frequencies to
+ * absolute numbers (see freq_to_popsize_ibmm), pass units on (see 
+ * annotate_frequencies_ibmm) and scale back to frequencies.
+ * @pre Rates have been calculated and frequencies of the source nodes are set. */
+template<class NET, class RNG>
+void simulate_genetics_ibmm(NET & net, RNG & rng)
+	{
+	freq_to_popsize_ibmm(net.nodes.begin(), net.nodes.end(), rng);
+
+	const auto & order = net.topological_order();
+	annotate_frequencies_ibmm(order.begin(), order.end(), rng);
+
+	for (auto node : net.nodes)
+		node->normalize();
+	}
+
+
+/** Run spread (see annotate_rates_ibmm) and genetics (see freq_to_popsize_ibmm, 
+ * annotate_frequencies_ibmm) on node in a single visit and scale its frequencies back 
+ * (the node doesn't change anymore once it has pushed to its outputs). 
+ *
+ * Rates from a previous run are overwritten, sources start from their preset input 
+ * again. This way a copy of a network can be given a new stochastic spread.
+ *
+ * @pre All input nodes have been processed. */
+template<class NODE, class RNG>
+void spread_genetics_ibmm(NODE * node, double transm_rate, RNG & rng)
+	{
+	// undo transmission of the previous run (inputs of other nodes are recalculated)
+	if (node->is_root())
+		node->rate_in_infd -= node->d_rate_in_infd;
+	node->d_rate_in_infd = 0;
+	node->rate_out_infd = 0;
+
+	// annotate_rates_ibmm leaves outputs alone if there is no infected input
+	for (auto l : node->outputs)
+		l->rate_infd = 0;
+
+	annotate_rates_ibmm(node, transm_rate, rng);
+
+	// only changes pre-set nodes (see set_allele_freqs), all others have received 
+	// absolute numbers from their inputs by now
+	freq_to_popsize_ibmm(node, rng);
+	annotate_frequencies_ibmm(node, rng);
+
+	node->normalize();
+	}
+
+/** Run spread_genetics_ibmm for a range of nodes.
+ * @pre The range is sorted topologically and contains all ancestors of its nodes (see 
+ * Network::topological_order). */
+template<class ITER, class RNG>
+void spread_genetics_ibmm(const ITER & beg, const ITER & end, double transm_rate, RNG & rng)
+	{
 	for (ITER i=beg; i!=end; i++)
-		(*i)->done = false;
+		spread_genetics_ibmm(*i, transm_rate, rng);
+	}
+
+
+/** Run the complete mechanistic model (new spread and genetics) on a network in a 
+ * single traversal (see spread_genetics_ibmm).
+ * @pre Link rates are set (and rescaled if necessary, see preserve_mass), source 
+ * nodes have their input set. Only pre-set nodes (sources and blocked nodes) have 
+ * non-zero frequencies. */
+template<class NET, class RNG>
+void simulate_ibmm(NET & net, double transm_rate, RNG & rng)
+	{
+	const auto & order = net.topological_order();
+	spread_genetics_ibmm(order.begin(), order.end(), transm_rate, rng);
 	}
 
 
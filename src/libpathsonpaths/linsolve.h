@@ -0,0 +1,305 @@
+#ifndef LINSOLVE_H
+#define LINSOLVE_H
+
+/** @file Solvers for sparse linear systems of the form x = W x + b. */
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+#include "util.h"
+
+using std::size_t;
+
+
+/** Sparse square matrix in compressed sparse row format. Rows are built one after the
+ * other (add entries, then end_row). */
+struct SparseMatrix
+	{
+	std::vector<size_t> offset;		//!< start of each row in col/val (plus end)
+	std::vector<size_t> col;		//!< column per entry
+	std::vector<double> val;		//!< value per entry
+
+	SparseMatrix()
+		: offset(1, 0)
+		{}
+
+	/** Number of rows. */
+	size_t size() const
+		{
+		return offset.size() - 1;
+		}
+
+	void clear()
+		{
+		offset.assign(1, 0);
+		col.clear();
+		val.clear();
+		}
+
+	/** Add an entry to the current row. Entries with the same column are summed up. */
+	void add(size_t c, double v)
+		{
+		col.push_back(c);
+		val.push_back(v);
+		}
+
+	void end_row()
+		{
+		offset.push_back(col.size());
+		}
+
+	/** y = x - W x */
+	void mul_id_minus(const std::vector<double> & x, std::vector<double> & y) const
+		{
+		for (size_t i=0; i<size(); i++)
+			{
+			double s = x[i];
+			for (size_t e=offset[i]; e<offset[i+1]; e++)
+				s -= val[e] * x[col[e]];
+			y[i] = s;
+			}
+		}
+	};
+
+
+namespace linsolve_detail
+	{
+	inline double dot(const std::vector<double> & a, const std::vector<double> & b)
+		{
+		double s = 0.0;
+		for (size_t i=0; i<a.size(); i++)
+			s += a[i] * b[i];
+		return s;
+		}
+
+	inline double norm(const std::vector<double> & a)
+		{
+		return std::sqrt(dot(a, a));
+		}
+
+	/** Solve (I - W) x = b by LU decomposition with partial pivoting. Throws if the
+	 * matrix is (numerically) singular. */
+	inline void solve_dense(const SparseMatrix & w, const std::vector<double> & b,
+		std::vector<double> & x)
+		{
+		const size_t n = w.size();
+
+		std::vector<double> a(n*n, 0.0);
+		for (size_t i=0; i<n; i++)
+			{
+			a[i*n+i] = 1.0;
+			for (size_t e=w.offset[i]; e<w.offset[i+1]; e++)
+				a[i*n+w.col[e]] -= w.val[e];
+			}
+
+		double a_max = 0.0;
+		for (double v : a)
+			a_max = std::max(a_max, std::abs(v));
+		const double eps = n * std::numeric_limits<double>::epsilon() * a_max;
+
+		x = b;
+
+		for (size_t k=0; k<n; k++)
+			{
+			size_t p = k;
+			for (size_t i=k+1; i<n; i++)
+				if (std::abs(a[i*n+k]) > std::abs(a[p*n+k]))
+					p = i;
+
+			ensure(std::abs(a[p*n+k]) > eps, "Rates in cycle did not converge");
+
+			if (p != k)
+				{
+				std::swap_ranges(a.begin()+k*n, a.begin()+(k+1)*n, a.begin()+p*n);
+				std::swap(x[k], x[p]);
+				}
+
+			const double * const rk = &a[k*n];
+			for (size_t i=k+1; i<n; i++)
+				{
+				double * const ri = &a[i*n];
+				const double f = ri[k] / rk[k];
+				if (f == 0.0)
+					continue;
+				for (size_t j=k+1; j<n; j++)
+					ri[j] -= f * rk[j];
+				x[i] -= f * x[k];
+				}
+			}
+
+		for (size_t k=n; k-->0; )
+			{
+			double s = x[k];
+			for (size_t j=k+1; j<n; j++)
+				s -= a[k*n+j] * x[j];
+			x[k] = s / a[k*n+k];
+			}
+		}
+	}
+
+
+/** Solve x = W x + b, i.e. (I - W) x = b. Small systems are solved directly (LU
+ * decomposition), larger ones with BiCGSTAB, preconditioned with the lower triangle 
+ * of I - W (a Gauss-Seidel sweep). Rows should therefore be ordered so that most 
+ * entries are below the diagonal, e.g. in the direction of flow. For the kind of 
+ * systems we get from material flowing through cycles (non-negative W that loses some
+ * material on the way) only the entries above the diagonal (the links that close 
+ * cycles) are left to the iteration. This takes far fewer steps than iterating 
+ * x = W x + b, in particular if most of the material goes round many times.
+ * @param w the matrix.
+ * @param b right hand side.
+ * @param x receives the solution, values on input are used as initial guess by the
+ * iterative solver (if x has the right size).
+ * @param tol tolerance of the residual per row, relative to b or x (whichever is 
+ * larger).
+ * @param max_iter maximum number of iterations, throws if the residual is still too
+ * large after that.
+ * @param max_direct largest system that is solved directly.
+ * @return number of iterations (0 for a direct solve). */
+inline size_t solve_fixed_point(const SparseMatrix & w, const std::vector<double> & b,
+	std::vector<double> & x, double tol, size_t max_iter, size_t max_direct = 256)
+	{
+	using namespace linsolve_detail;
+
+	const size_t n = w.size();
+	myassert(b.size() == n);
+
+	const double b_norm = norm(b);
+	if (b_norm == 0.0)
+		{
+		x.assign(n, 0.0);
+		return 0;
+		}
+
+	if (n <= max_direct)
+		{
+		solve_dense(w, b, x);
+		return 0;
+		}
+
+	if (x.size() != n)
+		x = b;
+
+	// preconditioner: solve for the lower triangle (plus diagonal) of I - W by forward
+	// substitution, i.e. a Gauss-Seidel sweep
+	std::vector<double> diag(n, 1.0);
+	for (size_t i=0; i<n; i++)
+		{
+		for (size_t e=w.offset[i]; e<w.offset[i+1]; e++)
+			if (w.col[e] == i)
+				diag[i] -= w.val[e];
+		if (diag[i] <= 0.0)
+			diag[i] = 1.0;
+		}
+
+	auto precond = [&w, &diag, n](const std::vector<double> & y, std::vector<double> & z)
+		{
+		for (size_t i=0; i<n; i++)
+			{
+			double v = y[i];
+			for (size_t e=w.offset[i]; e<w.offset[i+1]; e++)
+				if (w.col[e] < i)
+					v += w.val[e] * z[w.col[e]];
+			z[i] = v / diag[i];
+			}
+		};
+
+	std::vector<double> r(n), r0(n), p(n, 0.0), v(n, 0.0), s(n), t(n), ph(n), sh(n);
+	// per row, relative to the larger of b and x (which can be much larger than b if
+	// material goes round many times), so that rows with small values are accurate as
+	// well
+	auto converged = [&](const std::vector<double> & res)
+		{
+		for (size_t i=0; i<n; i++)
+			if (std::abs(res[i]) > tol * std::max(std::abs(b[i]), std::abs(x[i])))
+				return false;
+		return true;
+		};
+
+	size_t iter = 0;
+	// restarts from the true residual after a breakdown or if the recursively updated
+	// residual has drifted
+	while (iter < max_iter)
+		{
+		w.mul_id_minus(x, r);
+		for (size_t i=0; i<n; i++)
+			r[i] = b[i] - r[i];
+
+		if (converged(r))
+			return iter;
+
+		r0 = r;
+		double rho = 1.0, alpha = 1.0, omega = 1.0;
+		std::fill(p.begin(), p.end(), 0.0);
+		std::fill(v.begin(), v.end(), 0.0);
+
+		for (; iter < max_iter; iter++)
+			{
+			const double rho_new = dot(r0, r);
+			// breakdown, counts as an iteration so that restarts can't go on forever
+			if (rho_new == 0.0 || omega == 0.0)
+				{
+				iter++;
+				break;
+				}
+
+			const double beta = (rho_new / rho) * (alpha / omega);
+			for (size_t i=0; i<n; i++)
+				p[i] = r[i] + beta * (p[i] - omega * v[i]);
+			precond(p, ph);
+			w.mul_id_minus(ph, v);
+
+			const double r0v = dot(r0, v);
+			if (r0v == 0.0)
+				{
+				iter++;
+				break;
+				}
+			alpha = rho_new / r0v;
+
+			for (size_t i=0; i<n; i++)
+				s[i] = r[i] - alpha * v[i];
+
+			if (converged(s))
+				{
+				for (size_t i=0; i<n; i++)
+					x[i] += alpha * ph[i];
+				iter++;
+				break;
+				}
+
+			precond(s, sh);
+			w.mul_id_minus(sh, t);
+
+			const double tt = dot(t, t);
+			omega = tt > 0.0 ? dot(t, s) / tt : 0.0;
+
+			for (size_t i=0; i<n; i++)
+				{
+				x[i] += alpha * ph[i] + omega * sh[i];
+				r[i] = s[i] - omega * t[i];
+				}
+
+			rho = rho_new;
+
+			if (converged(r))
+				{
+				iter++;
+				break;
+				}
+			}
+		}
+
+	// final check of the true residual
+	w.mul_id_minus(x, r);
+	for (size_t i=0; i<n; i++)
+		r[i] = b[i] - r[i];
+	ensure(converged(r), "Rates in cycle did not converge");
+
+	return iter;
+	}
+
+
+#endif	// LINSOLVE_H
@@ -2,8 +2,11 @@
 #define NETWORK_H
 
 #include <vector>
+#include <type_traits>
 
 #include "util.h"
+#include "arena.h"
+#include "genericgraph.h"
 
 using std::size_t;
 
@@ -31,16 +34,23 @@ struct AbstractNetwork
  * to construct a network by adding links. Note that Node/Link objects are assumed to be 
  * owned by Network.
  * @param N node type.
- * @param L link type. */
-template<class N, class L>
+ * @param L link type.
+ * @param ALLOC allocation policy for nodes and links (HeapAlloc or ArenaAlloc, see 
+ * arena.h). */
+template<class N, class L, class ALLOC = HeapAlloc>
 struct Network : public AbstractNetwork
 	{
 	std::vector<N *> nodes;		//!< all nodes in the network
 	std::vector<L *> links;		//!< all edges in the network
 
-	Network() = default;
+	ALLOC alloc;				//!< creates and destroys nodes and links
+
+	Network()
+		: _sorted(false), _acyclic(false), _comps(false)
+		{}
 
 	Network(const Network & other)
+		: _sorted(false), _acyclic(false), _comps(false)
 		{
 		other.clone_into(*this);
 		}
@@ -49,6 +59,14 @@ struct Network : public AbstractNetwork
 		{
 		swap(tmp.nodes, this->nodes);
 		swap(tmp.links, this->links);
+		alloc.swap(tmp.alloc);
+		swap(tmp._order, _order);
+		swap(tmp._level_offset, _level_offset);
+		std::swap(tmp._sorted, _sorted);
+		std::swap(tmp._acyclic, _acyclic);
+		swap(tmp._comp_order, _comp_order);
+		swap(tmp._comp_offset, _comp_offset);
+		std::swap(tmp._comps, _comps);
 
 		return *this;
 		}
@@ -61,51 +79,113 @@ struct Network : public AbstractNetwork
 		if (nodes.size() <= std::max(from, to))
 			nodes.resize(std::max(from, to)+1, 0);
 		if (nodes[from] == 0)
-			nodes[from] = new N;
+			{
+			nodes[from] = alloc.template create<N>();
+			nodes[from]->id = from;
+			}
 		if (nodes[to] == 0)
-			nodes[to] = new N;
+			{
+			nodes[to] = alloc.template create<N>();
+			nodes[to]->id = to;
+			}
 
-		links.push_back(new L(nodes[from], nodes[to], rate));
-		nodes[from]->add_output(links.back());
-		nodes[to]->add_input(links.back());
+		links.push_back(alloc.template create<L>(nodes[from], nodes[to], rate));
+		links.back()->id = links.size()-1;
+		nodes[from]->add_output(links.back(), alloc);
+		nodes[to]->add_input(links.back(), alloc);
+
+		_sorted = false;
+		_comps = false;
 		}
 
 	void set_source(size_t s, double p, double i) {}
 
-	/** Find index of link @a l. */
-	size_t find_link(L * l) const
+	/** Reserve space for a network of (at least) the given size. */
+	void reserve(size_t n_nodes, size_t n_links)
 		{
-		for (size_t i=0; i<links.size(); i++)
-			if (l == links[i])
-				return i;
+		nodes.reserve(n_nodes);
+		links.reserve(n_links);
+		alloc.reserve(n_nodes * (sizeof(N) + alignof(N)) + n_links * (sizeof(L) + alignof(L)));
+		}
 
-		return links.size();
+	/** Find index of link @a l (constant time). */
+	size_t find_link(const L * l) const
+		{
+		return l->id;
 		}
 
-	/** Find index of node @a n. */
+	/** Find index of node @a n (constant time). */
 	size_t find_node_id(const N * n) const
 		{
-		for (size_t i=0; i<nodes.size(); i++)
-			if (n == nodes[i])
-				return i;
+		return n->id;
+		}
+
+	/** All nodes in topological order (inputs before outputs). Calculated on first use 
+	 * and kept until the topology changes. Throws if the network contains cycles. */
+	const std::vector<N *> & topological_order()
+		{
+		ensure(acyclic(), "Cycles in network detected");
+
+		return _order;
+		}
+
+	/** Whether the network is free of cycles (see topological_order). */
+	bool acyclic()
+		{
+		if (!_sorted)
+			{
+			_acyclic = topological_sort(nodes, _order, _level_offset);
+			_sorted = true;
+			}
 
-		return nodes.size();
+		return _acyclic;
 		}
 
-	/** Reset done status to false for all nodes. */
-	void reset_done()
+	/** All nodes grouped by strongly connected component, components in topological order
+	 * (see strong_components in genericgraph.h). Calculated on first use and kept until
+	 * the topology changes. */
+	const std::vector<N *> & component_order()
 		{
-		for (auto n : nodes)
-			n->done = false;
+		if (!_comps)
+			{
+			strong_components(nodes, _comp_order, _comp_offset);
+			_comps = true;
+			}
+
+		return _comp_order;
+		}
+
+	/** Start of each component in component_order() (plus the end of the last one). */
+	const std::vector<size_t> & component_offsets()
+		{
+		component_order();
+
+		return _comp_offset;
 		}
 
-	/** Destructor. Deletes all nodes and links. */
+	/** Start of each level in topological_order() (plus the end of the last one). 
+	 * Nodes within a level are independent of each other. */
+	const std::vector<size_t> & level_offsets()
+		{
+		topological_order();
+
+		return _level_offset;
+		}
+
+	/** Destructor. Deletes all nodes and links. If the allocation policy releases its 
+	 * memory as a whole and nodes and links need no destructor this takes constant 
+	 * time. */
 	~Network()
 		{
+		if (ALLOC::bulk && std::is_trivially_destructible<N>::value && 
+			std::is_trivially_destructible<L>::value)
+			return;
+
 		for (N * n : nodes)
-			delete n;
+			if (n)
+				alloc.destroy(n);
 		for (L * l : links)
-			delete l;
+			alloc.destroy(l);
 		}
 
 	/** Deep copy the content of this network into another one. Any previous content in the 
@@ -117,21 +197,23 @@ struct Network : public AbstractNetwork
 
 		// copy all links, pointer will be readjusted later
 		for (size_t i=0; i<links.size(); i++)
-			nn.links[i] = new L(*links[i]);
+			nn.links[i] = nn.alloc.template create<L>(*links[i]);
 
 		for (size_t i=0; i<nodes.size(); i++)
 			{
 			// copy node (pointers and all)
-			N * n = new N(*nodes[i]);
+			N * n = nn.alloc.template create<N>(*nodes[i]);
+			// adjacency lists might still point to our memory
+			seq_relocate(n->inputs, nn.alloc);
+			seq_relocate(n->outputs, nn.alloc);
 
 			// re-point input pointers
 			for (auto & l : n->inputs)
 				{
 				// this works because the node still has the old pointers
-				size_t li = find_link(l);
-				myassert(li < links.size());
+				myassert(l->id < links.size());
 				// use new link object
-				l = nn.links[li];
+				l = nn.links[l->id];
 				// point it to this node
 				l->to = n;
 				}
@@ -139,18 +221,38 @@ struct Network : public AbstractNetwork
 			// re-point output pointers
 			for (auto & l : n->outputs)
 				{
-				// this works because the node still has the old pointers
-				size_t li = find_link(l);
-				myassert(li < links.size());
-				// use new link object
-				l = nn.links[li];
-				// point it to this node
+				myassert(l->id < links.size());
+				l = nn.links[l->id];
 				l->from = n;
 				}
 			
 			nn.nodes[i] = n;
 			}
+
+		// same order, but with the new nodes
+		nn._order.resize(_order.size());
+		for (size_t i=0; i<_order.size(); i++)
+			nn._order[i] = nn.nodes[_order[i]->id];
+		nn._level_offset = _level_offset;
+		nn._sorted = _sorted;
+		nn._acyclic = _acyclic;
+
+		nn._comp_order.resize(_comp_order.size());
+		for (size_t i=0; i<_comp_order.size(); i++)
+			nn._comp_order[i] = nn.nodes[_comp_order[i]->id];
+		nn._comp_offset = _comp_offset;
+		nn._comps = _comps;
 		}
+
+protected:
+	std::vector<N *> _order;	//!< nodes in topological order
+	std::vector<size_t> _level_offset;	//!< start of each level in _order
+	bool _sorted;				//!< whether _order is up to date
+	bool _acyclic;				//!< whether the network is free of cycles (if _sorted)
+
+	std::vector<N *> _comp_order;	//!< nodes grouped by strongly connected component
+	std::vector<size_t> _comp_offset;	//!< start of each component in _comp_order
+	bool _comps;				//!< whether _comp_order is up to date
 	};
 
 
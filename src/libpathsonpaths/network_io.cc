@@ -1,43 +1,215 @@
 #include "network_io.h"
 
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <limits>
+
 #include "sputil.h"
+#include "util.h"
 
 using namespace std;
 
-void read_network(istream & in, AbstractNetwork & net)
+bool read_record(istream & in, NetRecord & rec)
 	{
-	istringstream istr;
 	string str;
 
-	do
-		{
-		skip_space(in, str);
-		if (!in.good())
-			return;
-		
-		istr.clear();
-		istr.str(str);
-		string tag;
-		size_t from, to;
-		double r;
+	skip_space(in, str);
+	if (!in.good() && str.empty())
+		return false;
+
+	istringstream istr(str);
+
+	istr >> rec.tag;
 
-		istr >> tag;
+	istr >> rec.from;
+	istr >> rec.to;
+	istr >> rec.rate;
 
-		istr >> from;
-		istr >> to;
-		istr >> r;
+	return true;
+	}
+
+void read_network(istream & in, AbstractNetwork & net)
+	{
+	NetRecord rec;
 
-		if (tag == "N")
-			net.add_link(from, to, r);
-		else if (tag == "S")
-			net.set_source(from, r);
+	while (read_record(in, rec))
+		{
+		if (rec.tag == "N")
+			net.add_link(rec.from, rec.to, rec.rate);
+		else if (rec.tag == "S")
+			net.set_source(rec.from, rec.rate);
 		else
 			{
-			cerr << "Error: unknown node type " <<tag << "!\n";
+			cerr << "Error: unknown node type " << rec.tag << "!\n";
 			exit(1);
 			}
 		}
-	while(in.good());
+	}
+
+
+namespace
+	{
+	/** State of a node that is held in memory by stream_fluid. */
+	struct LiveNode
+		{
+		double rate_in;
+		double rate_in_infd;
+		bool source;
+		};
+	}
+
+StreamStats stream_fluid(istream & in, ostream & out, double transm_rate, double decay)
+	{
+	const bool rescale = decay >= 0.0 && decay < 1.0;
+
+	StreamStats stats = {0, 0, 0};
+
+	// results are passed on, so we don't want to lose precision
+	const streamsize old_prec = out.precision(numeric_limits<double>::max_digits10);
+
+	unordered_map<size_t, LiveNode> live;
+	// nodes that have been written already
+	vector<bool> done;
+
+	auto is_done = [&done](size_t id)
+		{
+		return id < done.size() && done[id];
+		};
+
+	auto write = [&](size_t id, const LiveNode & n, double d_infd, double out_infd)
+		{
+		out << id << "\t" << n.rate_in << "\t" << n.rate_in_infd << "\t" 
+			<< d_infd << "\t" << out_infd << "\n";
+
+		if (done.size() <= id)
+			done.resize(id+1, false);
+		done[id] = true;
+		stats.n_nodes++;
+		};
+
+	// outputs of the current node
+	size_t cur = 0;
+	vector<pair<size_t, double> > outputs;
+
+	// same calculation as preserve_mass_annotate_rates, with the sums over inputs 
+	// done while reading
+	auto complete = [&]()
+		{
+		// no input so far (and not a source) => root without input
+		LiveNode n = {0.0, 0.0, false};
+		const auto i = live.find(cur);
+		if (i != live.end())
+			{
+			n = i->second;
+			live.erase(i);
+			}
+
+		if (rescale)
+			{
+			double outp = 0.0;
+			for (const auto & o : outputs)
+				outp += o.second;
+
+			ensure(outp > 0 || n.rate_in <= 0, "Output rates have to be positive.");
+
+			const double f = outp > 0 ? (n.rate_in * (1.0 - decay)) / outp : 0.0;
+
+			for (auto & o : outputs)
+				o.second *= f;
+			}
+
+		// we don't do infection for clean nodes
+		double d_infd = 0.0;
+		if (n.rate_in_infd > 0)
+			{
+			d_infd = transm_rate * (n.rate_in - n.rate_in_infd);
+			n.rate_in_infd += d_infd;
+			}
+
+		const double prop_infd = n.rate_in <= 0 ? 0 : n.rate_in_infd / n.rate_in;
+
+		double out_infd = 0.0;
+		for (const auto & o : outputs)
+			{
+			const double rate_infd = n.rate_in_infd > 0 ? o.second * prop_infd : 0.0;
+			out_infd += rate_infd;
+
+			LiveNode & to = live[o.first];
+			to.rate_in += o.second;
+			to.rate_in_infd += rate_infd;
+			}
+
+		write(cur, n, d_infd, out_infd);
+
+		outputs.clear();
+		stats.max_live = max(stats.max_live, live.size());
+		};
+
+	NetRecord rec;
+
+	while (read_record(in, rec))
+		{
+		if (rec.tag == "S")
+			{
+			ensure(!is_done(rec.from) && !(outputs.size() && cur == rec.from), 
+				"Sources have to be specified before their outputs.");
+
+			// outputs of the current node are only passed on when it is complete
+			for (const auto & o : outputs)
+				ensure(o.first != rec.from, "Sources can not have inputs.");
+
+			LiveNode & n = live[rec.from];
+			ensure(n.rate_in == 0 && !n.source, "Sources can not have inputs.");
+			// default overall input, see AbstractNetwork::set_source
+			n = {1.0, rec.rate, true};
+			continue;
+			}
+
+		ensure(rec.tag == "N", "Unknown record type.");
+
+		stats.n_links++;
+
+		// first output of a new node, the previous one is complete
+		if (outputs.size() && rec.from != cur)
+			complete();
+
+		ensure(!is_done(rec.from) && !is_done(rec.to), 
+			"Input is not sorted topologically.");
+		ensure(rec.from != rec.to, "Input is not sorted topologically.");
+
+		// in memory a preset input would be replaced by the node's inputs
+		const auto t = live.find(rec.to);
+		ensure(t == live.end() || !t->second.source, "Sources can not have inputs.");
+
+		cur = rec.from;
+		outputs.emplace_back(rec.to, rec.rate);
+		}
+
+	if (outputs.size())
+		complete();
+
+	// all remaining nodes are leaves (or unused sources)
+	vector<size_t> leaves;
+	for (const auto & n : live)
+		leaves.push_back(n.first);
+	sort(leaves.begin(), leaves.end());
+
+	for (size_t id : leaves)
+		{
+		LiveNode & n = live[id];
+		double d_infd = 0.0;
+		if (n.rate_in_infd > 0)
+			{
+			d_infd = transm_rate * (n.rate_in - n.rate_in_infd);
+			n.rate_in_infd += d_infd;
+			}
+		write(id, n, d_infd, 0.0);
+		}
+
+	out.precision(old_prec);
+
+	return stats;
 	}
 
 // TODO fix
@@ -2,14 +2,56 @@
 #define NETWORK_IO_H
 
 #include <iostream>
+#include <string>
 
 #include "network.h"
 
 
+/** One line of a network file. Links are written as "N from to rate", sources as 
+ * "S node node rate" (rate being the rate of infected input). */
+struct NetRecord
+	{
+	std::string tag;	//!< "N" or "S"
+	size_t from, to;
+	double rate;
+	};
+
+/** Read the next record from @a in. 
+ * @return false if there are no more records. */
+bool read_record(std::istream & in, NetRecord & rec);
+
 void read_network(std::istream & in, AbstractNetwork & net);
 void write_network(std::ostream & on, const AbstractNetwork & net);
 
 
+/** Summary of a streamed run (see stream_fluid). */
+struct StreamStats
+	{
+	size_t n_nodes;		//!< nodes written
+	size_t n_links;		//!< links read
+	size_t max_live;	//!< largest number of nodes held in memory at the same time
+	};
+
+/** Run the fluid model (see preserve_mass_annotate_rates) on a network that is read 
+ * record by record from @a in, without setting up the network in memory. The input is 
+ * expected to be sorted topologically by start node: all outputs of a node are 
+ * consecutive and come after all of its inputs, sources are specified before their 
+ * outputs. A node is therefore complete as soon as the first of its outputs is read.
+ *
+ * Only nodes that have received input but are not complete yet are kept in memory 
+ * (plus one bit per node id to detect unsorted input). Complete nodes are written to 
+ * @a out as "node rate_in rate_in_infd d_rate_in_infd rate_out_infd" (tab separated) 
+ * in the order they are completed. Leaves can only be completed at the end of the input,
+ * they are written last, sorted by id. All leaves therefore stay in memory until the 
+ * end, memory use is proportional to the number of leaves plus the largest number of 
+ * incomplete inner nodes.
+ *
+ * Results are the same as reading the network with read_network and running the fluid
+ * model on it. Throws if the input is not sorted or if a source has inputs.
+ * @param transm_rate rate of infection within nodes.
+ * @param decay if in [0, 1) output rates are rescaled (see preserve_mass). */
+StreamStats stream_fluid(std::istream & in, std::ostream & out, double transm_rate, 
+	double decay = -1.0);
 
 
 #endif	// NETWORK_IO_H
@@ -0,0 +1,62 @@
+#ifndef REPLICATES_H
+#define REPLICATES_H
+
+/** @file Independent replicates of stochastic simulations. */
+
+#include <cstdint>
+
+#include "threadpool.h"
+#include "streamrng.h"
+
+using std::size_t;
+
+
+/** Runs replicates of a stochastic simulation in parallel. Replicate i draws from its 
+ * own random stream (stream i of the runner's seed in domain STREAMS_REPLICATES, see 
+ * StreamRng), results therefore only depend on the seed and the replicate index, not on
+ * the number of threads or on which thread ends up running which replicate. */
+class ReplicateRunner
+	{
+public:
+	/** @param n_threads number of threads to use (including the calling one).
+	 * @param seed seed shared by all replicates. */
+	ReplicateRunner(size_t n_threads, uint64_t seed)
+		: _pool(n_threads), _seed(seed)
+		{}
+
+	/** Call @a func(i, rng) for all replicates i in [0, n), where rng is a StreamRng 
+	 * for replicate i. Blocks until all replicates are done, exceptions are passed on
+	 * to the caller (see ThreadPool::parallel_for). 
+	 * @param first index of the first replicate, so that a batch of replicates can be 
+	 * continued later on. */
+	template<class FUNC>
+	void run(size_t n, FUNC func, size_t first = 0)
+		{
+		const uint64_t seed = _seed;
+
+		// replicates are expensive enough to be handed out one by one
+		_pool.parallel_for(n, [&func, seed, first](size_t i)
+			{
+			StreamRng rng(seed, first + i, STREAMS_REPLICATES);
+			func(first + i, rng);
+			});
+		}
+
+	/** Number of threads. */
+	size_t n_threads() const
+		{
+		return _pool.size();
+		}
+
+	uint64_t seed() const
+		{
+		return _seed;
+		}
+
+protected:
+	ThreadPool _pool;
+	uint64_t _seed;
+	};
+
+
+#endif	// REPLICATES_H
@@ -0,0 +1,431 @@
+#ifndef SAMPLERS_H
+#define SAMPLERS_H
+
+/** @file Binomial, hypergeometric and gamma random variates. Self-contained (no R, no 
+ * GSL, no <random> distributions, which are implementation defined), so that they can be
+ * used from any thread (see StreamRng) and give the same results on every platform. */
+
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+
+/** Uniform double in (0, 1), never 0 so that its log is finite.
+ * @tparam URNG 64 bit uniform random bit generator (e.g. Xoshiro256). */
+template<class URNG>
+double uniform_open(URNG & eng)
+	{
+	static_assert(URNG::min() == 0 && URNG::max() == std::numeric_limits<uint64_t>::max(),
+		"64 bit generator required");
+
+	// 53 random bits, centered in their interval
+	return (double(eng() >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+	}
+
+
+/** log(n!). Not using std::lgamma since it is not guaranteed to be thread safe
+ * (signgam). Stirling series for larger n (relative error < 1e-13). */
+inline double log_factorial(int n)
+	{
+	if (n < 16)
+		{
+		double res = 0;
+		for (int i=2; i<=n; i++)
+			res += std::log(double(i));
+		return res;
+		}
+
+	const double x = n, x2 = x*x;
+	return x * std::log(x) - x + 0.5 * std::log(x) + 0.918938533204672742 +
+		(1.0/12 - (1.0/360 - 1.0/(1260*x2)) / x2) / x;
+	}
+
+
+/** Binomial variate by inversion (BINV, Kachitvichyanukul & Schmeiser 1988). Takes
+ * O(n*p) steps.
+ * @pre 0 < p <= 0.5 */
+template<class URNG>
+int binomial_binv(URNG & eng, int n, double p)
+	{
+	const double q = 1.0 - p;
+	const double s = p / q;
+	const double qn = std::exp(n * std::log(q));
+	// the tail beyond this is far below the precision of u
+	const double bound = std::min(double(n), n*p + 10.0 * std::sqrt(n*p*q + 1));
+
+	while (true)
+		{
+		double u = uniform_open(eng);
+		double px = qn;
+
+		for (int x=0; x<=bound; x++)
+			{
+			if (u <= px)
+				return x;
+
+			u -= px;
+			px *= s * (n - x) / (x + 1.0);
+			}
+		// rounding errors, start over
+		}
+	}
+
+
+/** Binomial variate by BTPE (Kachitvichyanukul & Schmeiser 1988): acceptance/rejection
+ * with a triangle, two parallelograms and two exponential tails as hull. Takes O(1)
+ * expected time.
+ * @pre p <= 0.5, n*p >= 30 (works for smaller values, but is slower than inversion). */
+template<class URNG>
+int binomial_btpe(URNG & eng, int n, double p)
+	{
+	// *** setup
+	const double q = 1.0 - p;
+	const double npq = n * p * q;
+	const double fm = n * p + p;
+	const int m = int(fm);
+
+	const double p1 = std::floor(2.195 * std::sqrt(npq) - 4.6 * q) + 0.5;
+	const double xm = m + 0.5;
+	const double xl = xm - p1;
+	const double xr = xm + p1;
+	const double c = 0.134 + 20.5 / (15.3 + m);
+
+	double a = (fm - xl) / (fm - xl * p);
+	const double lambda_l = a * (1.0 + 0.5 * a);
+	a = (xr - fm) / (xr * q);
+	const double lambda_r = a * (1.0 + 0.5 * a);
+
+	const double p2 = p1 * (1.0 + 2.0 * c);
+	const double p3 = p2 + c / lambda_l;
+	const double p4 = p3 + c / lambda_r;
+
+	while (true)
+		{
+		const double u = uniform_open(eng) * p4;
+		double v = uniform_open(eng);
+		int y;
+
+		// *** triangle, immediate acceptance
+		if (u <= p1)
+			return int(std::floor(xm - p1 * v + u));
+
+		// *** parallelograms
+		if (u <= p2)
+			{
+			const double x = xl + (u - p1) / c;
+			v = v * c + 1.0 - std::abs(m - x + 0.5) / p1;
+			if (v > 1.0)
+				continue;
+			y = int(std::floor(x));
+			}
+		// *** left tail
+		else if (u <= p3)
+			{
+			const double x = std::floor(xl + std::log(v) / lambda_l);
+			if (x < 0)
+				continue;
+			y = int(x);
+			v *= (u - p2) * lambda_l;
+			}
+		// *** right tail
+		else
+			{
+			const double x = std::floor(xr - std::log(v) / lambda_r);
+			if (x > n)
+				continue;
+			y = int(x);
+			v *= (u - p3) * lambda_r;
+			}
+
+		// *** acceptance test
+		const int k = std::abs(y - m);
+
+		// close to the mode: evaluate f(y)/f(m) by recursion
+		if (k <= 20 || k >= npq / 2 - 1)
+			{
+			const double s = p / q;
+			const double as = s * (n + 1);
+			double f = 1.0;
+
+			if (m < y)
+				for (int i=m+1; i<=y; i++)
+					f *= as / i - s;
+			else
+				for (int i=y+1; i<=m; i++)
+					f /= as / i - s;
+
+			if (v <= f)
+				return y;
+			continue;
+			}
+
+		// squeeze using bounds on log(f(y)/f(m))
+		const double rho = (k / npq) * ((k * (k / 3.0 + 0.625) + 1.0/6) / npq + 0.5);
+		const double t = -0.5 * k * k / npq;
+		const double alv = std::log(v);
+
+		if (alv < t - rho)
+			return y;
+		if (alv > t + rho)
+			continue;
+
+		// final test, Stirling's formula
+		const double x1 = y + 1, f1 = m + 1, z = n + 1 - m, w = n - y + 1;
+		const double x2 = x1*x1, f2 = f1*f1, z2 = z*z, w2 = w*w;
+
+		auto corr = [](double v, double v2)
+			{
+			return (13860. - (462. - (132. - (99. - 140. / v2) / v2) / v2) / v2) / v / 166320.;
+			};
+
+		if (alv <= xm * std::log(f1 / x1) + (n - m + 0.5) * std::log(z / w) +
+				(y - m) * std::log(w * p / (x1 * q)) +
+				corr(f1, f2) + corr(z, z2) + corr(x1, x2) + corr(w, w2))
+			return y;
+		}
+	}
+
+
+/** Number of successes in @a n trials with probability @a p. Uses inversion if
+ * n*min(p, 1-p) < 30 (exact and fast for small means) and BTPE otherwise. */
+template<class URNG>
+int binomial(URNG & eng, int n, double p)
+	{
+	if (n <= 0 || p <= 0)
+		return 0;
+	if (p >= 1)
+		return n;
+
+	const double r = std::min(p, 1.0 - p);
+	const int y = n * r < 30 ? binomial_binv(eng, n, r) : binomial_btpe(eng, n, r);
+
+	return p > 0.5 ? n - y : y;
+	}
+
+
+/** Hypergeometric variate by inversion (HIN, Kachitvichyanukul & Schmeiser 1985),
+ * starting at the lowest possible value. Takes O(mode - lowest value) steps.
+ * @pre n1 <= n2, k <= (n1+n2)/2 */
+template<class URNG>
+int hypergeometric_hin(URNG & eng, int n1, int n2, int k)
+	{
+	const int lo = std::max(0, k - n2), hi = std::min(n1, k);
+	const int tn = n1 + n2;
+
+	// p(lo) is scaled by 1e25 to avoid underflow
+	const double scale = 1e25, con = 57.5646273248511421;
+	const double w = k < n2 ?
+		std::exp(con + log_factorial(n2) + log_factorial(tn - k) -
+			log_factorial(n2 - k) - log_factorial(tn)) :
+		std::exp(con + log_factorial(n1) + log_factorial(k) -
+			log_factorial(k - n2) - log_factorial(tn));
+
+	while (true)
+		{
+		double u = uniform_open(eng) * scale;
+		double p = w;
+
+		for (int x=lo; x<=hi; x++)
+			{
+			if (u <= p)
+				return x;
+
+			u -= p;
+			p *= double(n1 - x) * (k - x) / ((x + 1.0) * (n2 - k + x + 1.0));
+			}
+		// rounding errors, start over
+		}
+	}
+
+
+/** Hypergeometric variate by H2PE (Kachitvichyanukul & Schmeiser 1985):
+ * acceptance/rejection with a rectangle and two exponential tails as hull. Takes O(1)
+ * expected time.
+ * @pre n1 <= n2, k <= (n1+n2)/2, mode - max(0, k-n2) >= 10 */
+template<class URNG>
+int hypergeometric_h2pe(URNG & eng, int n1, int n2, int k)
+	{
+	const double deltal = 0.0078, deltau = 0.0034;
+
+	const int lo = std::max(0, k - n2), hi = std::min(n1, k);
+	const double tn = double(n1) + n2;
+	const int m = int((k + 1.0) * (n1 + 1.0) / (tn + 2.0));
+
+	auto lf = [](double x) {return log_factorial(int(x));};
+
+	// *** setup
+	const double s = std::sqrt((tn - k) * k * n1 * n2 / (tn - 1) / tn / tn);
+	const double d = int(1.5 * s) + 0.5;
+	const double xl = m - d + 0.5;
+	const double xr = m + d + 0.5;
+	const double a = lf(m) + lf(n1 - m) + lf(k - m) + lf(n2 - k + m);
+	const double kl = std::exp(a - lf(xl) - lf(n1 - xl) - lf(k - xl) - lf(n2 - k + xl));
+	const double kr = std::exp(a - lf(xr - 1) - lf(n1 - xr + 1) - lf(k - xr + 1) -
+		lf(n2 - k + xr - 1));
+	const double lambda_l = -std::log(xl * (n2 - k + xl) / (n1 - xl + 1) / (k - xl + 1));
+	const double lambda_r = -std::log((n1 - xr + 1) * (k - xr + 1) / xr / (n2 - k + xr));
+	const double p1 = d + d;
+	const double p2 = p1 + kl / lambda_l;
+	const double p3 = p2 + kr / lambda_r;
+
+	while (true)
+		{
+		const double u = uniform_open(eng) * p3;
+		double v = uniform_open(eng);
+		int x;
+
+		// *** rectangle
+		if (u < p1)
+			{
+			x = int(xl + u);
+			if (x < lo || x > hi)
+				continue;
+			}
+		// *** left tail
+		else if (u <= p2)
+			{
+			const double y = xl + std::log(v) / lambda_l;
+			if (y < lo)
+				continue;
+			x = int(y);
+			v *= (u - p1) * lambda_l;
+			}
+		// *** right tail
+		else
+			{
+			const double y = xr - std::log(v) / lambda_r;
+			if (y > hi)
+				continue;
+			x = int(y);
+			v *= (u - p2) * lambda_r;
+			}
+
+		// *** acceptance test
+
+		// explicit evaluation of f(x)/f(m) by recursion
+		if (m < 100 || x <= 50)
+			{
+			double f = 1.0;
+			if (m < x)
+				for (int i=m+1; i<=x; i++)
+					f = f * (n1 - i + 1) * (k - i + 1) / (n2 - k + i) / i;
+			else
+				for (int i=x+1; i<=m; i++)
+					f = f * i * (n2 - k + i) / (n1 - i + 1) / (k - i + 1);
+
+			if (v <= f)
+				return x;
+			continue;
+			}
+
+		// squeeze using upper and lower bounds
+		const double y = x, y1 = y + 1.0, ym = y - m;
+		const double yn = n1 - y + 1.0, yk = k - y + 1.0, nk = n2 - k + y1;
+		const double r = -ym / y1, sq = ym / yn, t = ym / yk, e = -ym / nk;
+		const double g = yn * yk / (y1 * nk) - 1.0;
+		const double dg = g < 0 ? 1.0 + g : 1.0;
+		const double gu = g * (1.0 + g * (-0.5 + g / 3.0));
+		const double gl = gu - 0.25 * (g*g*g*g) / dg;
+		const double xm = m + 0.5, xn = n1 - m + 0.5, xk = k - m + 0.5, nm = n2 - k + xm;
+
+		auto s3 = [](double z) {return z * (1.0 + z * (-0.5 + z / 3.0));};
+		const double ub = y * gu - m * gl + deltau +
+			xm * s3(r) + xn * s3(sq) + xk * s3(t) + nm * s3(e);
+
+		const double alv = std::log(v);
+		if (alv > ub)
+			continue;
+
+		auto s4 = [](double w, double z)
+			{
+			const double res = w * (z*z*z*z);
+			return z < 0.0 ? res / (1.0 + z) : res;
+			};
+		const double dl = s4(xm, r) + s4(xn, sq) + s4(xk, t) + s4(nm, e);
+
+		if (alv < ub - 0.25 * dl + (y + m) * (gl - gu) - deltal)
+			return x;
+
+		// final test, Stirling's formula to machine accuracy
+		if (alv <= a - lf(x) - lf(n1 - x) - lf(k - x) - lf(n2 - k + x))
+			return x;
+		}
+	}
+
+
+/** Number of white balls in @a k draws without replacement from an urn with @a n1
+ * white and @a n2 black balls. Uses inversion for small spreads and H2PE otherwise.
+ * The problem is reduced to the smaller colour and at most half of the balls being
+ * drawn first. */
+template<class URNG>
+int hypergeometric(URNG & eng, int n1, int n2, int k)
+	{
+	const int lo = std::max(0, k - n2), hi = std::min(k, n1);
+	if (lo >= hi)
+		return lo;
+
+	const int tn = n1 + n2;
+	const bool swap_col = n1 > n2, swap_draw = k + k > tn;
+
+	const int s1 = swap_col ? n2 : n1, s2 = swap_col ? n1 : n2;
+	const int sk = swap_draw ? tn - k : k;
+
+	const int m = int((sk + 1.0) * (s1 + 1.0) / (tn + 2.0));
+	const int x = m - std::max(0, sk - s2) < 10 ?
+		hypergeometric_hin(eng, s1, s2, sk) : hypergeometric_h2pe(eng, s1, s2, sk);
+
+	// white balls drawn, from the number of balls of the smaller colour drawn (x) or
+	// left in the urn (if more than half were drawn)
+	if (swap_draw)
+		return swap_col ? k - n2 + x : n1 - x;
+	return swap_col ? k - x : x;
+	}
+
+
+/** Standard normal variate (Marsaglia's polar method, the second variate is dropped). */
+template<class URNG>
+double normal_variate(URNG & eng)
+	{
+	while (true)
+		{
+		const double u = 2.0 * uniform_open(eng) - 1.0, v = 2.0 * uniform_open(eng) - 1.0;
+		const double s = u*u + v*v;
+		if (s < 1.0 && s > 0.0)
+			return u * std::sqrt(-2.0 * std::log(s) / s);
+		}
+	}
+
+/** Gamma variate with scale 1 (Marsaglia & Tsang 2000). Shapes below 1 are drawn as 
+ * Gamma(shape+1) * U^(1/shape).
+ * @pre shape > 0 */
+template<class URNG>
+double gamma_variate(URNG & eng, double shape)
+	{
+	if (shape < 1.0)
+		{
+		const double u = uniform_open(eng);
+		return gamma_variate(eng, shape + 1.0) * std::exp(std::log(u) / shape);
+		}
+
+	const double d = shape - 1.0/3, c = 1.0 / std::sqrt(9.0 * d);
+
+	while (true)
+		{
+		double x, v;
+		do	{
+			x = normal_variate(eng);
+			v = 1.0 + c * x;
+			} while (v <= 0.0);
+
+		v = v*v*v;
+		const double u = uniform_open(eng), x2 = x*x;
+
+		// squeeze, then exact test
+		if (u < 1.0 - 0.0331 * x2*x2 || std::log(u) < 0.5 * x2 + d * (1.0 - v + std::log(v)))
+			return d * v;
+		}
+	}
+
+
+#endif	// SAMPLERS_H
@@ -0,0 +1,128 @@
+#ifndef STREAMRNG_H
+#define STREAMRNG_H
+
+/** @file Independent random number streams, e.g. one per node. */
+
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "samplers.h"
+
+
+/** SplitMix64, used to derive well mixed seeds from (seed, stream) pairs. */
+inline uint64_t splitmix64(uint64_t & x)
+	{
+	uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+	}
+
+
+/** Every use of a seed draws from its own domain of streams, so that e.g. replicate i 
+ * and node i simulated with the same seed don't get the same (or correlated) numbers. */
+enum StreamDomain : uint64_t
+	{
+	STREAMS_DEFAULT = 0,
+	STREAMS_SPREAD,			//!< per node, spread of the units model
+	STREAMS_DIRICHLET,		//!< per node, Dirichlet genetics
+	STREAMS_IBM,			//!< per node, units genetics
+	STREAMS_REPLICATES		//!< per replicate (see ReplicateRunner)
+	};
+
+
+/** xoshiro256** generator (Blackman/Vigna). Small state and cheap to seed, so that a 
+ * new generator can be set up for every node. Satisfies the requirements of a C++11
+ * uniform random bit generator. */
+class Xoshiro256
+	{
+public:
+	typedef uint64_t result_type;
+
+	/** Generator for stream @a stream in domain @a domain of seed @a seed. */
+	Xoshiro256(uint64_t seed, uint64_t stream = 0, uint64_t domain = STREAMS_DEFAULT)
+		{
+		// the domain tag goes into the hash of the stream id
+		uint64_t d = domain;
+		uint64_t t = stream ^ splitmix64(d);
+		uint64_t x = seed ^ splitmix64(t);
+		for (auto & s : _s)
+			s = splitmix64(x);
+		}
+
+	static constexpr result_type min() {return 0;}
+	static constexpr result_type max() {return std::numeric_limits<result_type>::max();}
+
+	result_type operator()()
+		{
+		const uint64_t res = rotl(_s[1] * 5, 7) * 9;
+		const uint64_t t = _s[1] << 17;
+
+		_s[2] ^= _s[0];
+		_s[3] ^= _s[1];
+		_s[1] ^= _s[2];
+		_s[0] ^= _s[3];
+
+		_s[2] ^= t;
+		_s[3] = rotl(_s[3], 45);
+
+		return res;
+		}
+
+protected:
+	static uint64_t rotl(uint64_t x, int k)
+		{
+		return (x << k) | (x >> (64 - k));
+		}
+
+	uint64_t _s[4];
+	};
+
+
+/** Random number stream with the interface expected by the stochastic kernels 
+ * (see ibmmixed.h). Streams with different stream ids (or domains, see StreamDomain) are
+ * independent, results therefore don't depend on the order (or the thread) in which 
+ * nodes are processed. All variates
+ * are drawn by the samplers in samplers.h, so that a seed gives the same results with
+ * every compiler and standard library. */
+class StreamRng
+	{
+public:
+	StreamRng(uint64_t seed, uint64_t stream, StreamDomain domain = STREAMS_DEFAULT)
+		: _eng(seed, stream, domain)
+		{}
+
+	/** Uniform double in [mi, ma). */
+	double outOf(double mi, double ma)
+		{
+		// 53 random bits in [0, 1)
+		return mi + (ma - mi) * (double(_eng() >> 11) * (1.0 / 9007199254740992.0));
+		}
+
+	/** Number of successes in @a n trials with probability @a p (see binomial). */
+	int binom(double p, int n)
+		{
+		return binomial(_eng, n, p);
+		}
+
+	/** Number of white balls in @a k draws without replacement from an urn with @a n1 
+	 * white and @a n2 black balls (see hypergeometric). */
+	int hypergeom(int n1, int n2, int k)
+		{
+		return hypergeometric(_eng, n1, n2, k);
+		}
+
+	/** Gamma distributed variate with scale 1 (see gamma_variate). */
+	double gamma(double shape)
+		{
+		return shape <= 0 ? 0 : gamma_variate(_eng, shape);
+		}
+
+protected:
+	Xoshiro256 _eng;
+	};
+
+
+#endif	// STREAMRNG_H
@@ -22,16 +22,16 @@ using StdVector = vector<T>;
 template<class GRAPH>
 struct MyDriftNode : 
 	public FreqNode<vector<double>>, 
-	public TranspNode,
+	public TranspNode<>,
 	public Node<GRAPH, StdVector>
 	{};
 
 template<class GRAPH>
-struct MyTranspLink : public TranspLink, public Link<GRAPH>
+struct MyTranspLink : public TranspLink<>, public Link<GRAPH>
 	{
 	MyTranspLink(typename GRAPH::node_t * f, typename GRAPH::node_t * t,
 		double a_rate = 0.0, double a_rate_infd = -1)
-		: TranspLink(a_rate, a_rate_infd), Link<GRAPH>(f, t)
+		: TranspLink<>(a_rate, a_rate_infd), Link<GRAPH>(f, t)
 		{}
 	};
 
@@ -110,11 +110,12 @@ int main()
 			}
 		}
 
-	annotate_rates(net.nodes.begin(), net.nodes.end(), 0.01);
+	const auto & order = net.topological_order();
+	annotate_rates(order.begin(), order.end(), 0.01);
 
 	Net_t net2 = net;
 
-	annotate_frequencies(net.nodes.begin(), net.nodes.end(), drift);
+	annotate_frequencies(order.begin(), order.end(), drift);
 
 	i = 0;
 	for (auto n : net.nodes)
@@ -143,7 +144,8 @@ int main()
 			}
 		}
 	
-	annotate_frequencies_ibmm(net2.nodes.begin(), net2.nodes.end(), rng);
+	const auto & order2 = net2.topological_order();
+	annotate_frequencies_ibmm(order2.begin(), order2.end(), rng);
 
 	i = 0;
 	for (auto n : net2.nodes)
@@ -0,0 +1,176 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+/** @file Simple thread pool for data parallel loops. */
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <algorithm>
+
+using std::size_t;
+
+
+/** Fixed-size pool of worker threads that cooperatively run loops. Only one loop can 
+ * run at a time, the calling thread takes part in the work. */
+class ThreadPool
+	{
+public:
+	/** @param n_threads number of threads to use, including the calling thread. */
+	explicit ThreadPool(size_t n_threads)
+		: _n(0), _grain(1), _next(0), _job(0), _n_busy(0), _stop(false)
+		{
+		for (size_t i=1; i<n_threads; i++)
+			_workers.emplace_back([this](){work();});
+		}
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool & operator=(const ThreadPool &) = delete;
+
+	~ThreadPool()
+		{
+			{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+			}
+		_cv_job.notify_all();
+
+		for (auto & t : _workers)
+			t.join();
+		}
+
+	/** Number of threads (including the calling one). */
+	size_t size() const
+		{
+		return _workers.size() + 1;
+		}
+
+	/** Call @a func(i) for all i in [0, n). Indices are handed out in chunks of @a grain.
+	 * Blocks until all calls have returned. Exceptions thrown by @a func are rethrown 
+	 * in the calling thread (remaining chunks are skipped in that case). */
+	template<class FUNC>
+	void parallel_for(size_t n, FUNC func, size_t grain = 1)
+		{
+		// not worth the synchronization
+		if (_workers.empty() || n <= grain)
+			{
+			for (size_t i=0; i<n; i++)
+				func(i);
+			return;
+			}
+
+			{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_body = [&func](size_t b, size_t e)
+				{
+				for (size_t i=b; i<e; i++)
+					func(i);
+				};
+			_n = n;
+			_grain = grain;
+			_next = 0;
+			_error = nullptr;
+			_n_busy = _workers.size();
+			_job++;
+			}
+		_cv_job.notify_all();
+
+		run_chunks();
+
+			{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_cv_done.wait(lock, [this](){return _n_busy == 0;});
+			}
+
+		if (_error)
+			std::rethrow_exception(_error);
+		}
+
+protected:
+	void work()
+		{
+		size_t seen = 0;
+
+		while (true)
+			{
+				{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_cv_job.wait(lock, [this, seen](){return _stop || _job != seen;});
+				if (_stop)
+					return;
+				seen = _job;
+				}
+
+			run_chunks();
+
+				{
+				std::lock_guard<std::mutex> lock(_mutex);
+				if (--_n_busy == 0)
+					_cv_done.notify_one();
+				}
+			}
+		}
+
+	void run_chunks()
+		{
+		try {
+			while (true)
+				{
+				const size_t b = _next.fetch_add(_grain);
+				if (b >= _n)
+					break;
+				_body(b, std::min(b + _grain, _n));
+				}
+			} 
+		catch (...)
+			{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (!_error)
+				_error = std::current_exception();
+			// skip the rest
+			_next = _n;
+			}
+		}
+
+	std::vector<std::thread> _workers;
+
+	std::function<void(size_t, size_t)> _body;	//!< runs a chunk of the current loop
+	size_t _n;						//!< size of the current loop
+	size_t _grain;					//!< chunk size of the current loop
+	std::atomic<size_t> _next;		//!< next index to hand out
+	std::exception_ptr _error;		//!< first exception thrown by the current loop
+
+	size_t _job;					//!< counts loops, wakes up workers
+	size_t _n_busy;					//!< workers still working on the current loop
+	bool _stop;
+
+	std::mutex _mutex;
+	std::condition_variable _cv_job;
+	std::condition_variable _cv_done;
+	};
+
+
+/** Apply @a func to all nodes level by level (see topological_sort in genericgraph.h). 
+ * Nodes within a level are processed in parallel, levels with no more than @a grain 
+ * nodes are processed by the calling thread only. 
+ * @param order nodes in topological order, grouped by level.
+ * @param level_offset start of each level in order (plus end). */
+template<class NODE, class FUNC>
+void parallel_levels(const std::vector<NODE *> & order, 
+	const std::vector<size_t> & level_offset, ThreadPool & pool, FUNC func, 
+	size_t grain = 256)
+	{
+	for (size_t l=0; l+1<level_offset.size(); l++)
+		{
+		NODE * const * level = order.data() + level_offset[l];
+		pool.parallel_for(level_offset[l+1] - level_offset[l], 
+			[level, &func](size_t i){func(level[i]);}, grain);
+		}
+	}
+
+
+#endif	// THREADPOOL_H
@@ -1,27 +1,44 @@
 #ifndef TRANSPORTGRAPH_H
 #define TRANSPORTGRAPH_H
 
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <iterator>
+#include <utility>
+
 #include "util.h"
+#include "linsolve.h"
 
-/** A link type that keeps track of transfer rates.  */
+/** A link type that keeps track of transfer rates.  
+ * @tparam REAL floating point type used for rates. */
+template<class REAL = double>
 struct TranspLink 
 	{
-	double rate;		//!< (absolute) transfer rate of material.
-	double rate_infd;	//!< (absolute) transfer rate of infected material.
+	typedef REAL real_t;
+
+	REAL rate;		//!< (absolute) transfer rate of material.
+	REAL rate_infd;	//!< (absolute) transfer rate of infected material.
 
 	TranspLink(double a_rate = 0.0, double a_rate_infd = 0.0)
-		: rate(a_rate), rate_infd(a_rate_infd)
+		: rate(REAL(a_rate)), rate_infd(REAL(a_rate_infd))
 		{}
 	};
 
 
-/** A node type that keeps track of input and output rates.*/
+/** A node type that keeps track of input and output rates. Kernels do their 
+ * calculations in the same precision that is used to store rates.
+ * @tparam REAL floating point type used for rates. */
+template<class REAL = double>
 struct TranspNode 
 	{
-	double rate_in;			//!< overall input rate.
-	double rate_in_infd;	//!< overall rate of input of infected material (@a after transmission).
-	double d_rate_in_infd;	//!< 
-	double rate_out_infd;
+	typedef REAL real_t;
+
+	REAL rate_in;			//!< overall input rate.
+	REAL rate_in_infd;		//!< overall rate of input of infected material (@a after transmission).
+	REAL d_rate_in_infd;	//!< 
+	REAL rate_out_infd;
 
 	bool blocked;
 
@@ -37,14 +54,14 @@ struct TranspNode
 		rate_out_infd = 0;
 		}
 
-	double prop_infected() const
+	REAL prop_infected() const
 		{
 		return rate_in <= 0 ?  
 			0 : rate_in_infd / rate_in;	
 		}
 
 	/** Probability an infected unit coming from this node was newly infected. */
-	double prob_newly_infected() const
+	REAL prob_newly_infected() const
 		{
 		// delta inf / inf
 		return rate_in_infd <= 0 ? 0 : d_rate_in_infd / rate_in_infd;
@@ -52,17 +69,17 @@ struct TranspNode
 	};
 
 
-/** Adjust output rates so that sum(output) = sum(input) * (1-decay). */
+/** Adjust output rates so that sum(output) = sum(input) * (1-decay). 
+ * @pre All input nodes have been processed. */
 template<class NODE>
 void preserve_mass(NODE * node, double decay)
 	{
-	if (node->done || node->is_leaf())
-		return;
+	typedef typename NODE::real_t real_t;
 
-	for (auto i : node->inputs)
-		preserve_mass(i->from, decay);
+	if (node->is_leaf())
+		return;
 
-	double inp = 0.0;
+	real_t inp = 0.0;
 
 	// root nodes use preset value
 	// we could allow for more flexibility (e.g. use preset if inp == 0)
@@ -73,37 +90,37 @@ void preserve_mass(NODE * node, double decay)
 		for (auto l : node->inputs)
 			inp += l->rate;
 
-	double outp = 0.0;
+	real_t outp = 0.0;
 	for (auto l : node->outputs)
 		outp += l->rate;
 
 	myassert(outp > 0);
 
-	const double f = (inp * (1.0 - decay)) / outp;
+	const real_t f = (inp * (real_t(1.0) - real_t(decay))) / outp;
 
 	for (auto l : node->outputs)
 		l->rate *= f;
-
-	node->done = true;
 	}
 
-/** Run preserve_mass for a range of nodes. */
+/** Run preserve_mass for a range of nodes. 
+ * @pre The range is sorted topologically and contains all ancestors of its nodes (see 
+ * Network::topological_order). */
 template<class ITER>
 void preserve_mass(const ITER & beg, const ITER & end, double decay)
 	{
 	for (ITER i=beg; i!=end; i++)
 		preserve_mass(*i, decay);
-
-	for (ITER i=beg; i!=end; i++)
-		(*i)->done = false;
 	}
 
 
 /** Calculate overall rate of infected input and proportion of infected material
  * in NODE node (after transmission) and in its output. 
  *
- * @note This function will call itself 
- * recursively for unprocessed input nodes.
+ * Can be run again on non-root nodes after their input has changed (see 
+ * TransportNetwork::update_downstream). Root nodes have to be reset (see 
+ * TransportNetwork::reset_source) first.
+ *
+ * @pre All input nodes have been processed.
  *
  * @tparam NODE node type.
  * @param node node to process.
@@ -112,9 +129,7 @@ void preserve_mass(const ITER & beg, const ITER & end, double decay)
 template<class NODE>
 void annotate_rates(NODE * node, double transm_rate)
 	{
-	// not processed yet
-	if (node->done)
-		return;
+	typedef typename NODE::real_t real_t;
 
 	// *** input
 
@@ -124,30 +139,32 @@ void annotate_rates(NODE * node, double transm_rate)
 	// does nothing for roots
 	for (auto link : node->inputs)
 		{
-		// do parents first
-		annotate_rates(link->from, transm_rate);
-
 		node->rate_in += link->rate;
 		node->rate_in_infd += link->rate_infd;
 		}
 
+	// values from a previous run
+	node->d_rate_in_infd = 0;
+	node->rate_out_infd = 0;
+
 	// we don't do infection for clean nodes
 	if (node->rate_in_infd <= 0)
 		{
-		node->done = true;
+		for (auto link : node->outputs)
+			link->rate_infd = 0;
 		return;
 		}
 	
 	// *** infection
 	
 	// proportion of input becomes infected
-	node->d_rate_in_infd = transm_rate * (node->rate_in - node->rate_in_infd);
+	node->d_rate_in_infd = real_t(transm_rate) * (node->rate_in - node->rate_in_infd);
 	node->rate_in_infd += node->d_rate_in_infd;
 
 	// *** output
 		
 	// proportion of infected units
-	const double prop_infd = node->prop_infected();
+	const real_t prop_infd = node->prop_infected();
 
 	// does nothing for leaves
 	for (typename NODE::link_t * link : node->outputs)
@@ -158,11 +175,12 @@ void annotate_rates(NODE * node, double transm_rate)
 
 		node->rate_out_infd += link->rate_infd;
 		}
-
-	node->done = true;
 	}
 
-/** Annotate rates for a collection of nodes and all their inputs (recursively). 
+/** Annotate rates for a collection of nodes. 
+ *
+ * @pre The range is sorted topologically and contains all ancestors of its nodes (see 
+ * Network::topological_order).
  *
  * @tparam ITER iterator over nodes.
  * @param beg, end range of nodes to be processed.
@@ -173,11 +191,306 @@ void annotate_rates(const ITER & beg, const ITER & end, double transm_rate)
 	{
 	for (ITER i=beg; i!=end; i++)
 		annotate_rates(*i, transm_rate);
+	}
 
+/** Rescale output rates (see preserve_mass) and calculate infection (see 
+ * annotate_rates) in a single visit, so that node and link data only have to be loaded
+ * once. Results are exactly the same as running both kernels one after the other.
+ *
+ * @pre All input nodes have been processed.
+ *
+ * @param node node to process.
+ * @param decay if in [0, 1) output rates are rescaled so that 
+ * sum(output) = sum(input) * (1-decay), otherwise they are left alone.
+ * @param transm_rate rate of infection within nodes
+ */
+template<class NODE>
+void preserve_mass_annotate_rates(NODE * node, double decay, double transm_rate)
+	{
+	typedef typename NODE::real_t real_t;
+
+	// *** input
+
+	if (!node->is_root())
+		node->rate_in = node->rate_in_infd = 0;
+
+	// does nothing for roots
+	for (auto link : node->inputs)
+		{
+		node->rate_in += link->rate;
+		node->rate_in_infd += link->rate_infd;
+		}
+
+	// *** mass preservation, input is the same as above (preset for roots)
+
+	if (decay >= 0.0 && decay < 1.0 && !node->is_leaf())
+		{
+		real_t outp = 0.0;
+		for (auto l : node->outputs)
+			outp += l->rate;
+
+		// outputs of nodes without input are set to 0, which is fine unless the node
+		// is visited again (see preserve_mass_annotate_rates_cyclic)
+		myassert(outp > 0 || node->rate_in <= 0);
+
+		const real_t f = outp > 0 ? 
+			(node->rate_in * (real_t(1.0) - real_t(decay))) / outp : real_t(0.0);
+
+		for (auto l : node->outputs)
+			l->rate *= f;
+		}
+
+	// *** infection and output, see annotate_rates
+
+	node->d_rate_in_infd = 0;
+	node->rate_out_infd = 0;
+
+	if (node->rate_in_infd <= 0)
+		{
+		for (auto link : node->outputs)
+			link->rate_infd = 0;
+		return;
+		}
+	
+	node->d_rate_in_infd = real_t(transm_rate) * (node->rate_in - node->rate_in_infd);
+	node->rate_in_infd += node->d_rate_in_infd;
+
+	const real_t prop_infd = node->prop_infected();
+
+	for (auto link : node->outputs)
+		{
+		link->rate_infd = link->rate * prop_infd;
+		node->rate_out_infd += link->rate_infd;
+		}
+	}
+
+/** Run preserve_mass_annotate_rates for a range of nodes.
+ * @pre The range is sorted topologically and contains all ancestors of its nodes (see 
+ * Network::topological_order). */
+template<class ITER>
+void preserve_mass_annotate_rates(const ITER & beg, const ITER & end, double decay, 
+	double transm_rate)
+	{
 	for (ITER i=beg; i!=end; i++)
-		(*i)->done = false;
+		preserve_mass_annotate_rates(*i, decay, transm_rate);
+	}
+
+
+/** Solve the fluid model (see preserve_mass_annotate_rates) for a group of nodes that
+ * are connected by cycles (a strongly connected component, see strong_components). 
+ * Rates within a cycle depend on each other. Both input rates (with rescaling) and 
+ * infected input rates are linear in the rates of the other nodes of the group, they 
+ * are therefore calculated by solving a linear system each (see solve_fixed_point), 
+ * directly for small groups. The iterative solver used for large groups converges
+ * fastest if nodes are in the direction of flow, e.g. in order of discovery (see 
+ * strong_components). Infection starts from scratch, i.e. material within the group 
+ * only becomes infected if infected material enters it from outside.
+ *
+ * There is a solution as long as material does not stay in the group forever, i.e. if 
+ * there is decay or if part of the material leaves the group. With rescaling a group 
+ * that receives no input from outside ends up empty.
+ *
+ * @pre All input nodes outside of the group have been processed.
+ *
+ * @param beg, end nodes of the group.
+ * @param decay if in [0, 1) output rates are rescaled (see preserve_mass).
+ * @param transm_rate rate of infection within nodes.
+ * @param tol relative tolerance for input rates (at least a few times the precision
+ * of the node's rate type).
+ * @param max_iter maximum number of iterations per system (only used for large 
+ * groups), throws if rates haven't converged by then.
+ * @return the number of iterations (0 if both systems were solved directly).
+ */
+template<class ITER>
+size_t preserve_mass_annotate_rates_cyclic(const ITER & beg, const ITER & end, 
+	double decay, double transm_rate, double tol = 1e-12, size_t max_iter = 10000)
+	{
+	typedef typename std::iterator_traits<ITER>::value_type node_ptr_t;
+	typedef decltype((*beg)->rate_in) real_t;
+
+	// rounding errors can keep values from converging any further
+	tol = std::max(tol, 8.0 * std::numeric_limits<real_t>::epsilon());
+
+	// local index = position in the group, which is also the order of rows in the linear
+	// systems (see solve_fixed_point)
+	const std::vector<node_ptr_t> group(beg, end);
+	const size_t n = group.size();
+
+	// (id, local index) sorted by id for lookup
+	std::vector<std::pair<size_t, size_t>> by_id(n);
+	for (size_t i=0; i<n; i++)
+		by_id[i] = {group[i]->id, i};
+	std::sort(by_id.begin(), by_id.end());
+
+	const size_t outside = n;
+	auto local = [&by_id, outside](node_ptr_t node)
+		{
+		const auto i = std::lower_bound(by_id.begin(), by_id.end(), 
+			std::make_pair(node->id, size_t(0)));
+		return i != by_id.end() && i->first == node->id ? i->second : outside;
+		};
+
+	// start node of every input link (local index or outside)
+	std::vector<size_t> from;
+	// input from outside the group, final already
+	std::vector<double> ext_in(n, 0.0), ext_infd(n, 0.0);
+	for (size_t i=0; i<n; i++)
+		for (auto l : group[i]->inputs)
+			{
+			from.push_back(local(l->from));
+			if (from.back() == outside)
+				{
+				ext_in[i] += l->rate;
+				ext_infd[i] += l->rate_infd;
+				}
+			}
+
+	auto out_rate = [](node_ptr_t node)
+		{
+		double outp = 0.0;
+		for (auto l : node->outputs)
+			outp += l->rate;
+		return outp;
+		};
+
+	// negative rates (beyond rounding errors) mean that there is no solution, i.e. 
+	// material stays in the group forever
+	auto check_sign = [tol](const std::vector<double> & v)
+		{
+		double v_max = 0.0;
+		for (double e : v)
+			v_max = std::max(v_max, std::abs(e));
+		for (double e : v)
+			ensure(e >= -tol * v_max, "Rates in cycle did not converge");
+		};
+
+	SparseMatrix w;
+	std::vector<double> x;
+	size_t iter = 0;
+
+	// *** mass preservation: rate_in(n) = ext_in(n) + sum_m share(m->n) * rate_in(m)
+
+	if (decay >= 0.0 && decay < 1.0)
+		{
+		std::vector<double> outp(n);
+		for (size_t i=0; i<n; i++)
+			outp[i] = out_rate(group[i]);
+
+		for (size_t i=0, k=0; i<n; i++)
+			{
+			for (auto l : group[i]->inputs)
+				{
+				const size_t j = from[k++];
+				if (j != outside && outp[j] > 0)
+					w.add(j, l->rate * (1.0 - decay) / outp[j]);
+				}
+			w.end_row();
+			}
+
+		iter += solve_fixed_point(w, ext_in, x, tol, max_iter);
+		check_sign(x);
+
+		for (size_t i=0; i<n; i++)
+			{
+			// nodes without input have their outputs set to 0 (see 
+			// preserve_mass_annotate_rates)
+			const real_t f = outp[i] > 0 && x[i] > 0 ? 
+				real_t(x[i] * (1.0 - decay) / outp[i]) : real_t(0.0);
+			for (auto l : group[i]->outputs)
+				l->rate *= f;
+			}
+		}
+
+	// with final link rates
+	for (auto node : group)
+		{
+		node->rate_in = 0;
+		for (auto l : node->inputs)
+			node->rate_in += l->rate;
+		}
+
+	// *** infection: after transmission rate_in_infd = (1-t) * input + t * rate_in, for 
+	// nodes that receive infected material at all
+
+	// nodes reachable from infected input
+	std::vector<bool> infd(n, false);
+	std::vector<size_t> stack;
+	for (size_t i=0; i<n; i++)
+		if (ext_infd[i] > 0)
+			{
+			infd[i] = true;
+			stack.push_back(i);
+			}
+	while (!stack.empty())
+		{
+		node_ptr_t node = group[stack.back()];
+		stack.pop_back();
+		if (node->rate_in <= 0)
+			continue;
+		for (auto l : node->outputs)
+			{
+			const size_t j = local(l->to);
+			if (j != outside && !infd[j] && l->rate > 0)
+				{
+				infd[j] = true;
+				stack.push_back(j);
+				}
+			}
+		}
+
+	std::vector<double> c(n, 0.0);
+	w.clear();
+	for (size_t i=0, k=0; i<n; i++)
+		{
+		for (auto l : group[i]->inputs)
+			{
+			const size_t j = from[k++];
+			if (infd[i] && j != outside && group[j]->rate_in > 0)
+				w.add(j, (1.0 - transm_rate) * l->rate / group[j]->rate_in);
+			}
+		w.end_row();
+
+		if (infd[i])
+			c[i] = (1.0 - transm_rate) * ext_infd[i] + transm_rate * group[i]->rate_in;
+		}
+
+	x.clear();
+	iter += solve_fixed_point(w, c, x, tol, max_iter);
+	check_sign(x);
+
+	// infected output with the solution, then the nodes' own values from their inputs
+	// like in preserve_mass_annotate_rates
+	for (size_t i=0; i<n; i++)
+		{
+		const real_t prop = group[i]->rate_in > 0 && x[i] > 0 ? 
+			real_t(x[i] / group[i]->rate_in) : real_t(0.0);
+		for (auto l : group[i]->outputs)
+			l->rate_infd = l->rate * prop;
+		}
+
+	for (auto node : group)
+		{
+		node->rate_in_infd = 0;
+		for (auto l : node->inputs)
+			node->rate_in_infd += l->rate_infd;
+
+		node->d_rate_in_infd = 0;
+		node->rate_out_infd = 0;
+
+		if (node->rate_in_infd <= 0)
+			continue;
+
+		node->d_rate_in_infd = real_t(transm_rate) * (node->rate_in - node->rate_in_infd);
+		node->rate_in_infd += node->d_rate_in_infd;
+
+		for (auto l : node->outputs)
+			node->rate_out_infd += l->rate_infd;
+		}
+
+	return iter;
 	}
 
+
 /** Probability of infected material from node @a n_from to end up in node @a n_to. 
  *
  * @pre Assumes that there is a link from @a n_from to @a n_to.
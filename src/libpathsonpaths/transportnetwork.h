@@ -4,13 +4,15 @@
 #include "util.h"
 
 #include "network.h"
+#include "transportgraph.h"
 
 //#include <iostream>
 
 
-/** Network class that supports transfer rates. */
-template<class N, class L>
-struct TransportNetwork : public Network<N, L>
+/** Network class that supports transfer rates. 
+ * @tparam NET storage backend (Network or CSRNetwork). */
+template<class N, class L, class NET = Network<N, L> >
+struct TransportNetwork : public NET
 	{
 	/** Make node @a s an external source with rate of infected set to @a r_infd. */
 	void set_source(size_t s, double r_infd, double r_in = 1.0)
@@ -20,7 +22,136 @@ struct TransportNetwork : public Network<N, L>
 		this->nodes[s]->rate_in = r_in;
 		this->nodes[s]->rate_in_infd = r_infd;
 		this->nodes[s]->d_rate_in_infd = 0;
+
+		if (_source_infd.size() <= s)
+			_source_infd.resize(s+1, 0.0);
+		_source_infd[s] = r_infd;
+		}
+
+	/** Give root node @a s back the infected input it was set to with set_source (0 if
+	 * it never was), i.e. undo transmission within the node. Nodes have to be reset before
+	 * they are processed again (see update_downstream). */
+	void reset_source(size_t s)
+		{
+		myassert(this->nodes.size() > s && this->nodes[s]->is_root());
+
+		this->nodes[s]->rate_in_infd = s < _source_infd.size() ? _source_infd[s] : 0.0;
+		this->nodes[s]->d_rate_in_infd = 0;
+		}
+
+	/** Keep the current link rates as input rates. Rescaling (decay in [0, 1)) 
+	 * overwrites link rates, with input rates kept update_downstream and solve_fluid
+	 * rescale from those instead. Otherwise a changed rate (see set_rate) would be 
+	 * rescaled together with sibling rates that have been rescaled before. */
+	void keep_rates()
+		{
+		_rate0.resize(this->links.size());
+		for (auto l : this->links)
+			_rate0[l->id] = l->rate;
+		}
+
+	/** Set the rate of link @a l to @a r (and its input rate if input rates are kept,
+	 * see keep_rates). */
+	void set_rate(size_t l, double r)
+		{
+		myassert(this->links.size() > l);
+
+		this->links[l]->rate = r;
+		if (!_rate0.empty())
+			_rate0[l] = r;
+		}
+
+	/** Recalculate rates after the input of some nodes has changed (e.g. a link rate or 
+	 * the input of a source). Only the nodes in [beg, end) and those downstream of them 
+	 * are processed, all other nodes keep their values. The result is the same as 
+	 * running preserve_mass and annotate_rates on the entire network.
+	 * @param beg, end nodes whose input or output rates have changed (for a changed 
+	 * link its start node, which sets the link's rate of infected material). Root nodes 
+	 * have to be reset with reset_source (or set_source) first.
+	 * @param transm_rate rate of infection within nodes.
+	 * @param decay if in [0, 1) output rates are rescaled as well (see preserve_mass), 
+	 * from the input rates if those are kept (see keep_rates). 
+	 * @pre The network has no cycles. */
+	template<class ITER>
+	void update_downstream(const ITER & beg, const ITER & end, double transm_rate, 
+		double decay = -1.0)
+		{
+		_marks.clear();
+		downstream_order(beg, end, _cone, _marks);
+
+		if (rescales(decay))
+			for (auto n : _cone)
+				restore_rates(n);
+
+		preserve_mass_annotate_rates(_cone.begin(), _cone.end(), decay, transm_rate);
+		}
+
+	/** Calculate rates for the entire network with the fluid model (see 
+	 * preserve_mass_annotate_rates). Unlike a sweep in topological order this works for
+	 * networks with cycles as well. The network is split into strongly connected 
+	 * components (calculated once per topology, see component_order), nodes that are not
+	 * part of a cycle are processed with a single visit, only cycles are solved as a 
+	 * linear system (see preserve_mass_annotate_rates_cyclic). Without cycles this is a 
+	 * plain sweep in topological order.
+	 * @param transm_rate rate of infection within nodes.
+	 * @param decay if in [0, 1) output rates are rescaled as well (see preserve_mass), 
+	 * from the input rates if those are kept (see keep_rates). 
+	 * @return the number of components with cycles. */
+	size_t solve_fluid(double transm_rate, double decay = -1.0)
+		{
+		if (rescales(decay))
+			for (auto n : this->nodes)
+				restore_rates(n);
+
+		if (this->acyclic())
+			{
+			const auto & order = this->topological_order();
+			preserve_mass_annotate_rates(order.begin(), order.end(), decay, transm_rate);
+			return 0;
+			}
+
+		const auto & comp_order = this->component_order();
+		const auto & comp_offset = this->component_offsets();
+		const size_t n_comp = comp_offset.size() - 1;
+
+		size_t n_cyclic = 0;
+		for (size_t c=0; c<n_comp; c++)
+			{
+			const auto b = comp_order.begin() + comp_offset[c];
+			const auto e = comp_order.begin() + comp_offset[c+1];
+
+			// single node without a link to itself
+			if (e - b == 1 && !(*b)->find_link_to(*b))
+				preserve_mass_annotate_rates(*b, decay, transm_rate);
+			else
+				{
+				preserve_mass_annotate_rates_cyclic(b, e, decay, transm_rate);
+				n_cyclic++;
+				}
+			}
+
+		return n_cyclic;
 		}
+
+protected:
+	/** Whether input rates are kept and output rates are rescaled with @a decay. */
+	bool rescales(double decay) const
+		{
+		return !_rate0.empty() && decay >= 0.0 && decay < 1.0;
+		}
+
+	/** Set the output rates of node @a n back to their input rates. */
+	void restore_rates(N * n)
+		{
+		for (auto l : n->outputs)
+			l->rate = _rate0[l->id];
+		}
+
+	std::vector<double> _source_infd;	//!< infected input per node as set by set_source
+	std::vector<double> _rate0;		//!< input rate per link (see keep_rates)
+
+	VisitMarks _marks;			//!< used by update_downstream
+	std::vector<N *> _cone;		//!< used by update_downstream
 	};
 
 #endif	// TRANSPORTNETWORK_H
@@ -0,0 +1,405 @@
+#ifndef TRANSPORTSOA_H
+#define TRANSPORTSOA_H
+
+/** @file Transport rates in structure-of-arrays layout. */
+
+#include <vector>
+#include <algorithm>
+
+#include "util.h"
+#include "csrnetwork.h"
+
+
+/** Rate state of a CSRNetwork with one contiguous array per field. Node arrays are indexed
+ * by node id, link arrays by link id, i.e. they have the same layout as 
+ * CSRNetwork::node_data and CSRNetwork::link_data. Sweeps that only need rates therefore
+ * don't have to pull entire node objects (including adjacency and allele frequencies) 
+ * through the cache. 
+ * @tparam REAL floating point type used for rates (independent of the network's). */
+template<class REAL = double>
+struct TranspSoA
+	{
+	typedef REAL real_t;
+
+	std::vector<REAL> rate_in;			//!< per node, see TranspNode
+	std::vector<REAL> rate_in_infd;		//!< per node, see TranspNode
+	std::vector<REAL> d_rate_in_infd;	//!< per node, see TranspNode
+	std::vector<REAL> rate_out_infd;	//!< per node, see TranspNode
+
+	std::vector<REAL> rate;				//!< per link, see TranspLink
+	std::vector<REAL> rate_infd;		//!< per link, see TranspLink
+
+	/** Copy rates from the nodes and links of @a net. */
+	template<class NET>
+	void load(const NET & net)
+		{
+		const size_t n_nodes = net.node_data.size();
+		const size_t n_links = net.link_data.size();
+
+		rate_in.resize(n_nodes);
+		rate_in_infd.resize(n_nodes);
+		d_rate_in_infd.resize(n_nodes);
+		rate_out_infd.resize(n_nodes);
+
+		for (size_t i=0; i<n_nodes; i++)
+			{
+			const auto & n = net.node_data[i];
+			rate_in[i] = n.rate_in;
+			rate_in_infd[i] = n.rate_in_infd;
+			d_rate_in_infd[i] = n.d_rate_in_infd;
+			rate_out_infd[i] = n.rate_out_infd;
+			}
+
+		rate.resize(n_links);
+		rate_infd.resize(n_links);
+
+		for (size_t i=0; i<n_links; i++)
+			{
+			const auto & l = net.link_data[i];
+			rate[i] = l.rate;
+			rate_infd[i] = l.rate_infd;
+			}
+		}
+
+	/** Copy rates back into the nodes and links of @a net. */
+	template<class NET>
+	void store(NET & net) const
+		{
+		myassert(net.node_data.size() == rate_in.size() && 
+			net.link_data.size() == rate.size());
+
+		for (size_t i=0; i<rate_in.size(); i++)
+			{
+			auto & n = net.node_data[i];
+			n.rate_in = rate_in[i];
+			n.rate_in_infd = rate_in_infd[i];
+			n.d_rate_in_infd = d_rate_in_infd[i];
+			n.rate_out_infd = rate_out_infd[i];
+			}
+
+		for (size_t i=0; i<rate.size(); i++)
+			{
+			auto & l = net.link_data[i];
+			l.rate = rate[i];
+			l.rate_infd = rate_infd[i];
+			}
+		}
+	};
+
+
+/** Adjust output rates so that sum(output) = sum(input) * (1-decay). Same as 
+ * preserve_mass in transportgraph.h, but on SoA rates. 
+ * @param topo topology of the network (nodes will be processed in topo.order).
+ * @param s rates. */
+template<class REAL>
+void preserve_mass(const CSRTopology & topo, TranspSoA<REAL> & s, double decay)
+	{
+	ensure(topo.order.size() == s.rate_in.size(), "Cycles in network detected");
+
+	REAL * const rate = s.rate.data();
+	const size_t * const in_idx = topo.in_idx.data();
+	const size_t * const out_idx = topo.out_idx.data();
+	const REAL keep = REAL(1.0) - REAL(decay);
+
+	for (const size_t n : topo.order)
+		{
+		const size_t ob = topo.out_offset[n], oe = topo.out_offset[n+1];
+		const size_t ib = topo.in_offset[n], ie = topo.in_offset[n+1];
+
+		// leaf
+		if (ob == oe)
+			continue;
+
+		// root nodes use preset value
+		REAL inp = ib == ie ? s.rate_in[n] : REAL(0.0);
+		for (size_t i=ib; i<ie; i++)
+			inp += rate[in_idx[i]];
+
+		REAL outp = 0.0;
+		for (size_t o=ob; o<oe; o++)
+			outp += rate[out_idx[o]];
+
+		myassert(outp > 0);
+
+		const REAL f = (inp * keep) / outp;
+
+		for (size_t o=ob; o<oe; o++)
+			rate[out_idx[o]] *= f;
+		}
+	}
+
+
+/** Calculate overall rate of infected input and proportion of infected material. Same as 
+ * annotate_rates in transportgraph.h, but on SoA rates. Can be re-run as well.
+ * @param topo topology of the network (nodes will be processed in topo.order).
+ * @param s rates.
+ * @param transm_rate rate of infection within nodes */
+template<class REAL>
+void annotate_rates(const CSRTopology & topo, TranspSoA<REAL> & s, double transm_rate)
+	{
+	ensure(topo.order.size() == s.rate_in.size(), "Cycles in network detected");
+
+	const REAL * const rate = s.rate.data();
+	REAL * const rate_infd = s.rate_infd.data();
+	const size_t * const in_idx = topo.in_idx.data();
+	const size_t * const out_idx = topo.out_idx.data();
+	const REAL transm = REAL(transm_rate);
+
+	for (const size_t n : topo.order)
+		{
+		const size_t ib = topo.in_offset[n], ie = topo.in_offset[n+1];
+
+		// roots keep their preset values
+		if (ib != ie)
+			{
+			REAL in = 0.0, in_infd = 0.0;
+			for (size_t i=ib; i<ie; i++)
+				{
+				const size_t l = in_idx[i];
+				in += rate[l];
+				in_infd += rate_infd[l];
+				}
+			s.rate_in[n] = in;
+			s.rate_in_infd[n] = in_infd;
+			}
+
+		// values from a previous run
+		s.d_rate_in_infd[n] = 0;
+		s.rate_out_infd[n] = 0;
+
+		const size_t ob = topo.out_offset[n], oe = topo.out_offset[n+1];
+
+		// we don't do infection for clean nodes
+		if (s.rate_in_infd[n] <= 0)
+			{
+			for (size_t o=ob; o<oe; o++)
+				rate_infd[out_idx[o]] = 0;
+			continue;
+			}
+
+		// proportion of input becomes infected
+		s.d_rate_in_infd[n] = transm * (s.rate_in[n] - s.rate_in_infd[n]);
+		s.rate_in_infd[n] += s.d_rate_in_infd[n];
+
+		const REAL prop_infd = s.rate_in[n] <= 0 ? 0 : s.rate_in_infd[n] / s.rate_in[n];
+
+		REAL out_infd = 0.0;
+		for (size_t o=ob; o<oe; o++)
+			{
+			const size_t l = out_idx[o];
+			rate_infd[l] = rate[l] * prop_infd;
+			out_infd += rate_infd[l];
+			}
+
+		s.rate_out_infd[n] = out_infd;
+		}
+	}
+
+
+/** Rate state of a CSRNetwork for a batch of parameter sets ("lanes"), e.g. a range of 
+ * transmission rates. Node values of lane k for node n are stored at n*width+k, so that
+ * the loops over lanes are contiguous and can be vectorized. Link rates are indexed by 
+ * the position of the link in CSRTopology::out_idx, i.e. the outputs of a node occupy a
+ * contiguous slice [out_offset[n], out_offset[n+1]); they are either shared between all
+ * lanes (only if all lanes use the same decay) or stored per lane as well. Infected 
+ * link rates are not stored, they are calculated from the proportion of infected 
+ * material in the link's start node when needed. 
+ *
+ * Memory use and the number of lanes per vector instruction depend on the size of
+ * @a REAL, with float ensembles of large networks therefore take half the space.
+ * @tparam REAL floating point type used for rates (independent of the network's). */
+template<class REAL = double>
+struct TranspBatch
+	{
+	typedef REAL real_t;
+
+	size_t width;						//!< number of lanes
+	bool shared_rates;					//!< whether all lanes use the same link rates
+
+	std::vector<REAL> rate_in;			//!< per node and lane, see TranspNode
+	std::vector<REAL> rate_in_infd;		//!< per node and lane, see TranspNode
+
+	std::vector<REAL> rate;				//!< per link (and lane if !shared_rates)
+
+	TranspBatch()
+		: width(0), shared_rates(true)
+		{}
+
+	/** Set all lanes to the rates of @a net.
+	 * @param net the network, has to be built.
+	 * @param a_width number of lanes.
+	 * @param shared whether to use one set of link rates for all lanes. */
+	template<class NET>
+	void load(const NET & net, size_t a_width, bool shared)
+		{
+		const CSRTopology & t = net.topology();
+		const size_t n_nodes = net.node_data.size();
+		const size_t n_links = t.out_idx.size();
+
+		width = a_width;
+		shared_rates = shared;
+
+		rate_in.resize(n_nodes * width);
+		rate_in_infd.resize(n_nodes * width);
+
+		for (size_t i=0; i<n_nodes; i++)
+			{
+			const auto & n = net.node_data[i];
+			std::fill_n(rate_in.begin() + i*width, width, n.rate_in);
+			std::fill_n(rate_in_infd.begin() + i*width, width, n.rate_in_infd);
+			}
+
+		const size_t lw = shared_rates ? 1 : width;
+		rate.resize(n_links * lw);
+
+		for (size_t i=0; i<n_links; i++)
+			std::fill_n(rate.begin() + i*lw, lw, net.link_data[t.out_idx[i]].rate);
+		}
+
+	/** Proportion of infected material in node @a n for lane @a k. */
+	REAL prop_infected(size_t n, size_t k) const
+		{
+		const size_t i = n*width + k;
+		return rate_in[i] <= 0 ? 0 : rate_in_infd[i] / rate_in[i];
+		}
+	};
+
+
+/** Adjust output rates so that sum(output) = sum(input) * (1-decay), with a different 
+ * decay for every lane. Same as preserve_mass in transportgraph.h, but for a batch.
+ * @param topo topology of the network (nodes will be processed in topo.order).
+ * @param s rates, need to have per lane link rates.
+ * @param decay decay per lane. */
+template<class REAL>
+void preserve_mass(const CSRTopology & topo, TranspBatch<REAL> & s, 
+	const std::vector<double> & decay)
+	{
+	ensure(topo.order.size() * s.width == s.rate_in.size(), "Cycles in network detected");
+	myassert(!s.shared_rates && decay.size() == s.width);
+
+	const size_t w = s.width;
+	REAL * const rate = s.rate.data();
+	std::vector<REAL> inp(w), outp(w);
+	// 1-decay in working precision
+	std::vector<REAL> keep(w);
+	for (size_t k=0; k<w; k++)
+		keep[k] = REAL(1.0) - REAL(decay[k]);
+
+	for (const size_t n : topo.order)
+		{
+		const size_t ob = topo.out_offset[n], oe = topo.out_offset[n+1];
+		const size_t ib = topo.in_offset[n], ie = topo.in_offset[n+1];
+
+		// leaf
+		if (ob == oe)
+			continue;
+
+		// root nodes use preset value
+		if (ib == ie)
+			std::copy_n(s.rate_in.begin() + n*w, w, inp.begin());
+		else
+			std::fill(inp.begin(), inp.end(), REAL(0.0));
+
+		for (size_t i=ib; i<ie; i++)
+			{
+			const REAL * r = rate + topo.in_slot[i]*w;
+			for (size_t k=0; k<w; k++)
+				inp[k] += r[k];
+			}
+
+		std::fill(outp.begin(), outp.end(), REAL(0.0));
+		for (size_t o=ob; o<oe; o++)
+			{
+			const REAL * r = rate + o*w;
+			for (size_t k=0; k<w; k++)
+				outp[k] += r[k];
+			}
+
+		for (size_t k=0; k<w; k++)
+			{
+			myassert(outp[k] > 0);
+			// re-use inp for the factor
+			inp[k] = (inp[k] * keep[k]) / outp[k];
+			}
+
+		for (size_t o=ob; o<oe; o++)
+			{
+			REAL * r = rate + o*w;
+			for (size_t k=0; k<w; k++)
+				r[k] *= inp[k];
+			}
+		}
+	}
+
+
+/** Calculate overall rate of infected input and proportion of infected material, with
+ * a different transmission rate for every lane. Same as annotate_rates in 
+ * transportgraph.h, but for a batch.
+ * @param topo topology of the network (nodes will be processed in topo.order).
+ * @param s rates.
+ * @param transm_rate rate of infection within nodes per lane. */
+template<class REAL>
+void annotate_rates(const CSRTopology & topo, TranspBatch<REAL> & s, 
+	const std::vector<double> & transm_rate)
+	{
+	ensure(topo.order.size() * s.width == s.rate_in.size(), "Cycles in network detected");
+	myassert(transm_rate.size() == s.width);
+
+	const size_t w = s.width;
+	const REAL * const rate = s.rate.data();
+	REAL * const rate_in = s.rate_in.data();
+	REAL * const rate_in_infd = s.rate_in_infd.data();
+	std::vector<REAL> prop(w);
+	// transmission rates in working precision
+	const std::vector<REAL> transm(transm_rate.begin(), transm_rate.end());
+
+	for (const size_t n : topo.order)
+		{
+		const size_t ib = topo.in_offset[n], ie = topo.in_offset[n+1];
+		REAL * const in = rate_in + n*w;
+		REAL * const in_infd = rate_in_infd + n*w;
+
+		// roots keep their preset values
+		if (ib != ie)
+			{
+			std::fill_n(in, w, REAL(0.0));
+			std::fill_n(in_infd, w, REAL(0.0));
+			}
+
+		for (size_t i=ib; i<ie; i++)
+			{
+			const size_t from = topo.link_from[topo.in_idx[i]];
+			// same calculation as in annotate_rates for the start node
+			for (size_t k=0; k<w; k++)
+				prop[k] = rate_in[from*w+k] <= 0 ? 
+					0 : rate_in_infd[from*w+k] / rate_in[from*w+k];
+
+			const size_t l = topo.in_slot[i];
+			if (s.shared_rates)
+				{
+				const REAL r = rate[l];
+				for (size_t k=0; k<w; k++)
+					{
+					in[k] += r;
+					in_infd[k] += r * prop[k];
+					}
+				}
+			else
+				{
+				const REAL * r = rate + l*w;
+				for (size_t k=0; k<w; k++)
+					{
+					in[k] += r[k];
+					in_infd[k] += r[k] * prop[k];
+					}
+				}
+			}
+
+		// proportion of input becomes infected (nothing happens in clean lanes)
+		for (size_t k=0; k<w; k++)
+			in_infd[k] += in_infd[k] <= 0 ? REAL(0.0) : transm[k] * (in[k] - in_infd[k]);
+		}
+	}
+
+
+#endif	// TRANSPORTSOA_H
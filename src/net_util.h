@@ -16,7 +16,8 @@ struct Cycles
 	const vector<vector<size_t>> & net; //!< Network as children per node.
 	vector<bool> visited;				//!< Within calls (cycles).
 	vector<bool> done;					//!< Between calls (optimization).
-	vector<size_t> stack;
+	vector<size_t> stack;				//!< Current path.
+	vector<size_t> next;				//!< Next child to check per node in stack.
 	vector<vector<size_t>> res;			//! A list of cycles.
 
 	/** Plain constructor. */
@@ -26,50 +27,92 @@ struct Cycles
 
 	/** Detect if there's at least one cycle in the subnetwork reachable from node cur. This 
 	 * can be significantly faster than tracking down all cycles. Note that calling this
-	 * directly on a non-source node might produce false positives down the line. */
+	 * directly on a non-source node might produce false positives down the line. 
+	 * Depth-first search with an explicit stack, so path length is only limited by 
+	 * memory. */
 	bool has_cycles(size_t cur)
 		{
+		stack.push_back(cur);
+		next.push_back(0);
 		visited[cur] = true;	// this will detect cycles
 		done[cur] = true;		// we keep track of processed nodes so we can skip them
 
-		// check children
-		for (size_t i : net[cur])
+		while (!stack.empty())
 			{
+			const size_t n = stack.back();
+
+			// entire subtree has been checked, clean up
+			if (next.back() == net[n].size())
+				{
+				visited[n] = false;
+				stack.pop_back();
+				next.pop_back();
+				continue;
+				}
+
+			// check next child
+			const size_t i = net[n][next.back()++];
+
 			if (visited[i])	// been here => cycle!
+				{
+				stack.clear();
+				next.clear();
 				return true;
+				}
 
 			if (!done[i])	// hasn't been processed => do it now
-				if (has_cycles(i))
-					return true;
+				{
+				stack.push_back(i);
+				next.push_back(0);
+				visited[i] = true;
+				done[i] = true;
+				}
 			}
 
-		visited[cur] = false;	// entire subtree has been checked, clean up
 		return false;
 		}
 
-	/** Find and record all cycles in the subnetwork reachable from cur. */
+	/** Find and record all cycles in the subnetwork reachable from cur. Depth-first search
+	 * with an explicit stack, so path length is only limited by memory. */
 	void find_cycles(size_t cur)
 		{
 		stack.push_back(cur);	// keep track of current path
+		next.push_back(0);
+		visited[cur] = true;	// marks nodes on the current path
 		done[cur] = true;
 
-		// check children
-		for (size_t i : net[cur])
+		while (!stack.empty())
 			{
+			const size_t n = stack.back();
+
+			// all children checked
+			if (next.back() == net[n].size())
+				{
+				visited[n] = false;
+				stack.pop_back();
+				next.pop_back();
+				continue;
+				}
+
+			const size_t i = net[n][next.back()++];
+
 			// are we crossing our own path?
-			const auto f = std::find(stack.begin(), stack.end(), i);
 			// if so, add the entire loop to the list of cycles
-			if (f != stack.end())
+			if (visited[i])
 				{
+				const auto f = std::find(stack.begin(), stack.end(), i);
 				res.push_back(vector<size_t>(f, stack.end()));
 				continue;
 				}
 
 			if (!done[i])
-				find_cycles(i);
+				{
+				stack.push_back(i);
+				next.push_back(0);
+				visited[i] = true;
+				done[i] = true;
+				}
 			}
-
-		stack.pop_back();
 		}
 	};
 
@@ -2,11 +2,13 @@
 
 #include "libpathsonpaths/sputil.h"
 
+#include <cmath>
+
 
 void print_node_id(const Net_t * net, size_t i)
 	{
-	if (net->name_by_id.size())
-		Rcout << net->name_by_id[i];
+	if (net->name_by_id().size())
+		Rcout << net->name_by_id()[i];
 	else
 		Rcout << i;
 	}
@@ -14,6 +16,25 @@ void print_node_id(const Net_t * net, size_t i)
 void print_popsnode(const Node_t * n) {};
 
 
+uint64_t stream_seed(Nullable<NumericVector> seed)
+	{
+	// a single draw only gives 32 random bits, the upper and lower half of the seed are 
+	// drawn separately
+	if (seed.isNull())
+		{
+		const uint64_t hi = uint64_t(R::unif_rand() * 4294967296.0);
+		const uint64_t lo = uint64_t(R::unif_rand() * 4294967296.0);
+		return hi << 32 | lo;
+		}
+
+	const NumericVector s(seed.as());
+	R_ASSERT(s.size() == 1 && std::isfinite(s[0]) && s[0] >= 0 && s[0] == std::floor(s[0]) &&
+		s[0] < 18446744073709551616.0, "Seed has to be a single non-negative whole number.");
+
+	return uint64_t(s[0]);
+	}
+
+
 void _set_allele_freqs(Net_t * net, const List & ini)
 	{
 	const IntegerVector nodes = ini(0);
@@ -28,11 +49,10 @@ void _set_allele_freqs(Net_t * net, const List & ini)
 	for (auto n : net->nodes)
 		{
 		// set all to 0
-		n->frequencies.resize(n_all);
-		fill(n->frequencies.begin(), n->frequencies.end(), 0);
+		n->frequencies.assign(n_all, 0);
 		// root nodes start with wild type
 		if (n->is_root())
-			n->frequencies[0] = 1.0;
+			set_allele(n->frequencies, 0, 1.0);
 		}
 
 	const bool f = nodes.inherits("factor");
@@ -42,14 +62,15 @@ void _set_allele_freqs(Net_t * net, const List & ini)
 	// assign ini frequencies
 	for (size_t i=0; i<nodes.size(); i++)
 		{
-		const size_t n = f ? net->id_by_name[string(levels(nodes(i)-1))] : nodes[i];
+		const size_t n = f ? net->id_by_name().at(string(levels(nodes(i)-1))) : nodes[i];
 
 		R_ASSERT(n < net->nodes.size(), "Invalid node index");
 
 		Node_t * node = net->nodes[n];
 
+		node->frequencies.assign(n_all, 0);
 		for (size_t j=0; j<n_all; j++)
-			node->frequencies[j] = freqs(i, j);
+			set_allele(node->frequencies, j, freqs(i, j));
 
 		// no additional input into this node
 		node->blocked = true;
@@ -64,7 +85,7 @@ size_t id_from_SEXP(const Net_t & net, SEXP id)
 	case INTSXP:
 		return as<int>(id);
 	case STRSXP:
-		return net.id_by_name.at(as<string>(id));
+		return net.id_by_name().at(as<string>(id));
 	default:
 		stop("Node id has to be integer or string");
 		}
@@ -75,7 +96,7 @@ void sample_node(const Node_t & node, size_t n, vector<size_t> & count)
 	{
 	R_ASSERT(count.size() == node.frequencies.size(), "Invalid number of alleles in node");
 
-	ProportionalPick<> pick(0.000001, node.frequencies);
+	AllelePick<Node_t::freq_t> pick(node.frequencies, 0.000001);
 	RRng r;
 
 	for (size_t i=0; i<n; i++)
@@ -85,22 +106,11 @@ void sample_node(const Node_t & node, size_t n, vector<size_t> & count)
 
 double distance_freq(const Node_t & n1, const Node_t & n2)
 	{
-	double d = 0.0;
-
-	for (int i=0; i<n1.frequencies.size(); i++)
-		d += pow<2>(n1.frequencies[i] - n2.frequencies[i]);
-
-	return d/n1.frequencies.size();
+	return sum_sq_diff(n1.frequencies, n2.frequencies) / n1.frequencies.size();
 	}
 
 
 double distance_EHamming(const Node_t & n1, const Node_t & n2)
 	{
-	double d = 0.0;
-
-	for (int i=0; i<n1.frequencies.size(); i++)
-		d += n1.frequencies[i] * n2.frequencies[i];
-
-	return 1.0 - d;
+	return 1.0 - sum_prod(n1.frequencies, n2.frequencies);
 	}
-
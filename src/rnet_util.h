@@ -8,7 +8,7 @@
 
 #include <Rcpp.h>
 
-#include "libpathsonpaths/proportionalpick.h"
+#include "libpathsonpaths/genefreqgraph.h"
 
 #include "rpathsonpaths_types.h"
 #include "rcpp_util.h"
@@ -19,27 +19,31 @@ using namespace Rcpp;
 
 
 /** Drift operator for the continuous model. Implements a Dirichlet distribution using
- * R::rgamma. */
+ * gamma variates drawn from RNG (see Rng, StreamRng). */
+template<class RNG>
 struct Drift
 	{
 	typedef typename Node_t::freq_t::value_type num_t;
 	num_t theta;	//!< Scaling parameter for the Dirichlet distribution.
+	RNG & rng;
 
-	Drift(double t)
-		: theta(t)
+	Drift(double t, RNG & r)
+		: theta(t), rng(r)
 		{ }
 
-	/** Apply drift to dreqs and store result in res. */
-	void operator()(const Node_t::freq_t & freqs, Node_t::freq_t & res)
+	/** Apply drift to freqs and store result in res. */
+	template<class CONT>
+	void operator()(const CONT & freqs, CONT & res)
 		{
-		R_ASSERT(res.size() == freqs.size(), 
-			"Drift: result vector has to be same size as input vector");
+		res = freqs;
 
 		num_t norm = 0.0;		
 
-		// draw from a Gamma distribution
-		for (size_t i=0; i<freqs.size(); i++)
-			norm += (res[i] = R::rgamma(freqs[i] * theta, 1.0));
+		// draw from a Gamma distribution, absent alleles stay absent
+		for_each_allele(res, [this, &norm](size_t, num_t & f)
+			{
+			norm += (f = rng.gamma(f * theta));
+			});
 
 		// normalize
 		for (num_t & f : res)
@@ -48,7 +52,8 @@ struct Drift
 	};
 
 
-/** Binomial and hypergeometric distributions for the mechanistic model. */
+/** Binomial, hypergeometric and gamma distributions for the stochastic models, using 
+ * R's generator (single-threaded only, see StreamRng). */
 struct Rng
 	{
 	int binom(double p, int n) const
@@ -60,9 +65,20 @@ struct Rng
 		{
 		return R::rhyper(n1, n2, k);
 		}
+
+	/** Gamma distributed variate with scale 1. */
+	double gamma(double shape) const
+		{
+		return R::rgamma(shape, 1.0);
+		}
 	};
 
 
+/** Seed for random number streams (see StreamRng). Drawn from R's generator if @a seed
+ * is NULL, otherwise it has to be a non-negative whole number. */
+uint64_t stream_seed(Nullable<NumericVector> seed);
+
+
 /** Print (using R output) node i of network net. */
 void print_node_id(const Net_t * net, size_t i);
 
@@ -88,7 +104,7 @@ void sample_node(const Node_t & node, size_t n, vector<size_t> & count);
 template<class CONT>
 void sample_alleles_node(const Node_t & node, CONT & alleles)
 	{
-	ProportionalPick<> pick(0.000001, node.frequencies);
+	AllelePick<Node_t::freq_t> pick(node.frequencies, 0.000001);
 	RRng r;
 
 	for (auto & a : alleles)
@@ -4,14 +4,15 @@
 /** @file Custom network class. */
 
 #include "libpathsonpaths/transportnetwork.h"
+#include "libpathsonpaths/csrnetwork.h"
 
 #include <unordered_map>
+#include <memory>
 
 using namespace std;
 
-/** Our custom network class. Only necessary because we want to store factor stuff. */
-template<class N, class L>
-struct RNetwork : public TransportNetwork<N, L>
+/** Factor levels of a network's nodes. */
+struct NodeNames
 	{
 	//! Map factor levels to internal node index.
 	unordered_map<string, size_t> id_by_name;
@@ -19,5 +20,40 @@ struct RNetwork : public TransportNetwork<N, L>
 	vector<string> name_by_id;
 	};
 
+/** Our custom network class. Only necessary because we want to store factor stuff. 
+ * Uses contiguous storage so that copies (one per simulation run) are cheap. Topology and
+ * node names are shared between copies, a copy therefore only holds node and link state
+ * (rates and allele frequencies). */
+template<class N, class L>
+struct RNetwork : public TransportNetwork<N, L, CSRNetwork<N, L> >
+	{
+	//! Node names, shared between copies.
+	shared_ptr<const NodeNames> names;
+
+	//! Spread model the network was created with (needed for updates).
+	string spread_model;
+	//! Transmission rate the network was created with (needed for updates).
+	double transmission;
+	//! Decay the network was created with (needed for updates).
+	double decay;
+
+	RNetwork()
+		: names(make_shared<NodeNames>()), spread_model("fluid"), transmission(0.0), 
+		decay(-1.0)
+		{}
+
+	//! Map factor levels to internal node index.
+	const unordered_map<string, size_t> & id_by_name() const
+		{
+		return names->id_by_name;
+		}
+
+	//! Factor level of each of our nodes.
+	const vector<string> & name_by_id() const
+		{
+		return names->name_by_id;
+		}
+	};
+
 
 #endif	// RNETWORK_H
@@ -11,6 +11,7 @@
 #include "libpathsonpaths/transportgraph.h"
 #include "libpathsonpaths/driftapprox.h"
 #include "libpathsonpaths/genefreqgraph.h"
+#include "libpathsonpaths/csrnetwork.h"
 
 #include "rnetwork.h"
 
@@ -20,31 +21,35 @@
 using namespace std;
 
 
-// for some reason we need this
-template<class T>
-using StdVector = vector<T>;
-
-
 // assemble all required node components
-template<class GRAPH>
-struct MyDriftNode : 
-	public FreqNode<vector<double>>, 
-	public TranspNode,
-	public Node<GRAPH, StdVector>
+// nodes are stored in a CSRNetwork, so we use its adjacency ranges as link containers
+// REAL is the floating point type used for rates and allele frequencies
+// only alleles present in a node are stored
+template<class REAL, class GRAPH>
+struct RealDriftNode : 
+	public FreqNode<SparseFreqs<REAL>>, 
+	public TranspNode<REAL>,
+	public Node<GRAPH, CSRRange>
 	{};
 
 
 // we need a new constructor, so we actually have to implement a new class here
-template<class GRAPH>
-struct MyTranspLink : public TranspLink, public Link<GRAPH>
+template<class REAL, class GRAPH>
+struct RealTranspLink : public TranspLink<REAL>, public Link<GRAPH>
 	{
-	MyTranspLink(typename GRAPH::node_t * f, typename GRAPH::node_t * t,
+	RealTranspLink(typename GRAPH::node_t * f, typename GRAPH::node_t * t,
 		double a_rate = 0.0, double a_rate_infd = 0)
-		: TranspLink(a_rate, a_rate_infd), Link<GRAPH>(f, t)
+		: TranspLink<REAL>(a_rate, a_rate_infd), Link<GRAPH>(f, t)
 		{}
 	};
 
 
+// Graph expects templates with a single parameter
+template<class GRAPH>
+using MyDriftNode = RealDriftNode<double, GRAPH>;
+template<class GRAPH>
+using MyTranspLink = RealTranspLink<double, GRAPH>;
+
 // tie everything together
 typedef Graph<MyDriftNode, MyTranspLink> G_t;
 typedef G_t::node_t Node_t;
@@ -55,4 +60,17 @@ typedef G_t::link_t Link_t;
 typedef RNetwork<Node_t, Link_t> Net_t;
 
 
+// single precision variant, half the memory for rates and allele frequencies
+template<class GRAPH>
+using MyDriftNodeF = RealDriftNode<float, GRAPH>;
+template<class GRAPH>
+using MyTranspLinkF = RealTranspLink<float, GRAPH>;
+
+typedef Graph<MyDriftNodeF, MyTranspLinkF> GF_t;
+typedef GF_t::node_t NodeF_t;
+typedef GF_t::link_t LinkF_t;
+
+typedef RNetwork<NodeF_t, LinkF_t> NetF_t;
+
+
 #endif	// RPATHSONPATHS_TYPES_H